@@ -57,6 +57,7 @@ using namespace std;
 #include "RemoteTools.h"
 #include "LuaTools.h"
 #include "DFHackVersion.h"
+#include "Profiler.h"
 
 #include "MiscUtils.h"
 
@@ -444,6 +445,7 @@ static const std::set<std::string> built_in_commands = {
     "enable" ,
     "disable" ,
     "plug" ,
+    "profile" ,
     "keybinding" ,
     "alias" ,
     "fpause" ,
@@ -934,6 +936,7 @@ command_result Core::runCommand(color_ostream &con, const std::string &first_, v
                 "  fpause                      - Force DF to pause.\n"
                 "  die                         - Force DF to close immediately\n"
                 "  kill-lua                    - Stop an active Lua script\n"
+                "  profile start|stop|write F  - Sample where the main thread spends its time.\n"
                 "  keybinding                  - Modify bindings of commands to keys\n"
                 "  script FILENAME             - Run the commands specified in a file.\n"
                 "  sc-script                   - Automatically run specified scripts on state change events\n"
@@ -1183,6 +1186,56 @@ command_result Core::runCommand(color_ostream &con, const std::string &first_, v
             if (!Lua::Interrupt(force))
                 con.printerr("Failed to register hook - use 'kill-lua force' to force\n");
         }
+        else if (builtin == "profile")
+        {
+            string cmd = parts.empty() ? "status" : parts[0];
+
+            if (cmd == "start")
+            {
+                int hz = parts.size() > 1 ? atoi(parts[1].c_str()) : 1000;
+                if (!Profiler::isSupported())
+                {
+                    con.printerr("The profiler is not available on this platform.\n");
+                    return CR_FAILURE;
+                }
+                if (!Profiler::start(hz))
+                {
+                    con.printerr("Invalid sampling frequency: %s\n", parts[1].c_str());
+                    return CR_WRONG_USAGE;
+                }
+                con.print("Profiling at %d Hz from the next frame.\n", hz);
+            }
+            else if (cmd == "stop")
+            {
+                Profiler::stop();
+                con.print("Profiling stops at the next frame; %zu samples so far.\n",
+                          Profiler::getSampleCount());
+            }
+            else if (cmd == "status")
+            {
+                if (Profiler::isRunning())
+                    con.print("Profiling at %d Hz: ", Profiler::getFrequency());
+                else
+                    con.print("Not profiling: ");
+                con.print("%zu samples, %zu dropped.\n",
+                          Profiler::getSampleCount(), Profiler::getDroppedCount());
+            }
+            else if (cmd == "write" && parts.size() == 2)
+            {
+                std::ofstream file(parts[1]);
+                if (!file || !Profiler::writeFolded(file))
+                {
+                    con.printerr("Could not write %s\n", parts[1].c_str());
+                    return CR_FAILURE;
+                }
+                con.print("Wrote %zu samples to %s\n", Profiler::getSampleCount(), parts[1].c_str());
+            }
+            else
+            {
+                con << "Usage: profile start [HZ]|stop|status|write FILE" << endl;
+                return CR_WRONG_USAGE;
+            }
+        }
         else if (builtin == "script")
         {
             if(parts.size() == 1)
@@ -2046,11 +2099,22 @@ void Core::doUpdate(color_ostream &out, bool first_update)
 }
 
 // should always be from simulation thread!
+void jobs_beginUpdate();
+void jobs_endUpdate();
+void profiler_onUpdate();
+
 int Core::Update()
 {
     if(errorstate)
         return -1;
 
+    // DF is stopped during the update hooks, so caches over its lists are
+    // safe there; they are dropped before suspended tools get to run
+    jobs_beginUpdate();
+
+    // Profiler timers have to be set up on the thread they sample
+    profiler_onUpdate();
+
     color_ostream_proxy out(con);
 
     // Pretend this thread has suspended the core in the usual way,
@@ -2064,22 +2128,32 @@ int Core::Update()
             first_update = true;
             Init();
             if(errorstate)
+            {
+                jobs_endUpdate();
                 return -1;
+            }
             Lua::Core::Reset(con, "core init");
         }
 
         doUpdate(out, first_update);
+        jobs_endUpdate();
     }
 
     // Let all commands run that require CoreSuspender
     CoreWakeup.wait(MainThread::suspend(),
             [this]() -> bool {return this->toolCount.load() == 0;});
 
+    // Store changes made this frame in the world before DF can save it
+    World::FlushPersistentStore();
+
     return 0;
 };
 
 extern bool buildings_do_onupdate;
 void buildings_onStateChange(color_ostream &out, state_change_event event);
+void materials_onStateChange(color_ostream &out, state_change_event event);
+void items_onStateChange(color_ostream &out, state_change_event event);
+void rpc_onStateChange(state_change_event event);
 void buildings_onUpdate(color_ostream &out);
 
 static int buildings_timer = 0;
@@ -2276,6 +2350,11 @@ void Core::onStateChange(color_ostream &out, state_change_event event)
         std::cerr << "loaded map in prerelease build" << std::endl;
     }
 
+    // raw lookups must be fresh before anything below resolves tokens
+    materials_onStateChange(out, event);
+    items_onStateChange(out, event);
+    rpc_onStateChange(event);
+
     EventManager::onStateChange(out, event);
 
     buildings_onStateChange(out, event);
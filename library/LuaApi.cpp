@@ -48,6 +48,7 @@ distribution.
 #include "modules/Constructions.h"
 #include "modules/Designations.h"
 #include "modules/Filesystem.h"
+#include "modules/FloodFill.h"
 #include "modules/Gui.h"
 #include "modules/Items.h"
 #include "modules/Job.h"
@@ -492,6 +493,88 @@ static int dfhack_persistent_deleteTilemask(lua_State *state)
     return 1;
 }
 
+static const char *const persistent_value_types[] = {
+    "blob", "string", "int", "number", "legacy", NULL
+};
+
+static int dfhack_persistent_getValue(lua_State *state)
+{
+    CoreSuspender suspend;
+
+    std::string key = luaL_checkstring(state, 1);
+    std::string data;
+    uint8_t type;
+
+    if (!World::GetPersistentValue(key, &data, &type))
+    {
+        lua_pushnil(state);
+        return 1;
+    }
+
+    if (type == World::PERSIST_INT && data.size() == 8)
+    {
+        uint64_t v = 0;
+        for (int b = 0; b < 8; b++)
+            v |= uint64_t(uint8_t(data[b])) << (8*b);
+        lua_pushinteger(state, lua_Integer(int64_t(v)));
+    }
+    else if (type == World::PERSIST_NUMBER && data.size() == sizeof(double))
+    {
+        double v;
+        memcpy(&v, data.data(), sizeof(v));
+        lua_pushnumber(state, v);
+    }
+    else
+        lua_pushlstring(state, data.data(), data.size());
+
+    if (type <= World::PERSIST_LEGACY)
+        lua_pushstring(state, persistent_value_types[type]);
+    else
+        lua_pushinteger(state, type);
+    return 2;
+}
+
+static int dfhack_persistent_setValue(lua_State *state)
+{
+    CoreSuspender suspend;
+
+    std::string key = luaL_checkstring(state, 1);
+    bool ok;
+
+    if (lua_isnoneornil(state, 2))
+        ok = World::DeletePersistentValue(key);
+    else if (lua_type(state, 2) == LUA_TNUMBER && lua_isinteger(state, 2))
+        ok = World::SetPersistentInt(key, lua_tointeger(state, 2));
+    else if (lua_type(state, 2) == LUA_TNUMBER)
+    {
+        double v = lua_tonumber(state, 2);
+        ok = World::SetPersistentValue(key, std::string((char*)&v, sizeof(v)), World::PERSIST_NUMBER);
+    }
+    else
+    {
+        size_t len;
+        const char *str = luaL_checklstring(state, 2, &len);
+        int type = luaL_checkoption(state, 3, "string", persistent_value_types);
+        if (type != World::PERSIST_BLOB && type != World::PERSIST_STRING)
+            luaL_argerror(state, 3, "only blob and string values can be set from a string");
+        ok = World::SetPersistentValue(key, std::string(str, len), uint8_t(type));
+    }
+
+    lua_pushboolean(state, ok);
+    return 1;
+}
+
+static int dfhack_persistent_listValues(lua_State *state)
+{
+    CoreSuspender suspend;
+
+    std::vector<std::string> keys;
+    World::ListPersistentValues(&keys, luaL_optstring(state, 1, ""));
+
+    Lua::PushVector(state, keys);
+    return 1;
+}
+
 static const luaL_Reg dfhack_persistent_funcs[] = {
     { "get", dfhack_persistent_get },
     { "delete", dfhack_persistent_delete },
@@ -499,6 +582,9 @@ static const luaL_Reg dfhack_persistent_funcs[] = {
     { "save", dfhack_persistent_save },
     { "getTilemask", dfhack_persistent_getTilemask },
     { "deleteTilemask", dfhack_persistent_deleteTilemask },
+    { "getValue", dfhack_persistent_getValue },
+    { "setValue", dfhack_persistent_setValue },
+    { "listValues", dfhack_persistent_listValues },
     { NULL, NULL }
 };
 
@@ -718,8 +804,15 @@ static int dfhack_matinfo_matches(lua_State *state)
     return 1;
 }
 
+static int dfhack_matinfo_invalidateIndexes(lua_State *state)
+{
+    invalidateRawTokenIndexes();
+    return 0;
+}
+
 static const luaL_Reg dfhack_matinfo_funcs[] = {
     { "find", dfhack_matinfo_find },
+    { "invalidateIndexes", dfhack_matinfo_invalidateIndexes },
     { "decode", dfhack_matinfo_decode },
     { "getToken", dfhack_matinfo_getToken },
     { "toString", dfhack_matinfo_toString },
@@ -1911,6 +2004,48 @@ static int maps_getTileBiomeRgn(lua_State *L)
     return Lua::PushPosXY(L, Maps::getTileBiomeRgn(pos));
 }
 
+static int maps_floodFill(lua_State *L)
+{
+    df::coord start;
+    Lua::CheckDFAssign(L, &start, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    bool has_visit = !lua_isnoneornil(L, 3);
+    if (has_visit)
+        luaL_checktype(L, 3, LUA_TFUNCTION);
+
+    unsigned flags = 0;
+    if (lua_istable(L, 4))
+    {
+        lua_getfield(L, 4, "diagonal");
+        if (lua_toboolean(L, -1))
+            flags |= FloodFill::DIAGONAL;
+        lua_getfield(L, 4, "vertical");
+        if (lua_toboolean(L, -1))
+            flags |= FloodFill::VERTICAL;
+        lua_pop(L, 2);
+    }
+
+    FloodFill::Engine filler([L](df::coord pos) {
+        lua_pushvalue(L, 2);
+        Lua::Push(L, pos);
+        lua_call(L, 1, 1);
+        bool ok = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+        return ok;
+    }, flags);
+
+    size_t count = filler.fill(start, [L, has_visit](df::coord pos) {
+        if (!has_visit)
+            return;
+        lua_pushvalue(L, 3);
+        Lua::Push(L, pos);
+        lua_call(L, 1, 0);
+    });
+
+    lua_pushinteger(L, count);
+    return 1;
+}
+
 static const luaL_Reg dfhack_maps_funcs[] = {
     { "isValidTilePos", maps_isValidTilePos },
     { "isTileVisible", maps_isTileVisible },
@@ -1920,6 +2055,7 @@ static const luaL_Reg dfhack_maps_funcs[] = {
     { "getTileFlags", maps_getTileFlags },
     { "getRegionBiome", maps_getRegionBiome },
     { "getTileBiomeRgn", maps_getTileBiomeRgn },
+    { "floodFill", maps_floodFill },
     { NULL, NULL }
 };
 
@@ -1983,6 +2119,9 @@ static const LuaWrapper::FunctionReg dfhack_burrows_module[] = {
     WRAPN(setAssignedBlockTile, burrows_setAssignedBlockTile),
     WRAPM(Burrows, isAssignedTile),
     WRAPM(Burrows, setAssignedTile),
+    WRAPM(Burrows, unionTiles),
+    WRAPM(Burrows, subtractTiles),
+    WRAPM(Burrows, intersectTiles),
     { NULL, NULL }
 };
 
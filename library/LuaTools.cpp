@@ -24,10 +24,14 @@ distribution.
 
 #include "Internal.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <csignal>
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 
 #include "MemAccess.h"
 #include "Core.h"
@@ -364,7 +368,11 @@ static int dfhack_lineedit(lua_State *S)
 
 volatile std::sig_atomic_t lstop = 0;
 
+extern std::atomic<bool> profiler_lua_wanted;
+void profiler_publishLua(lua_State *L, lua_Debug *ar);
+
 static void interrupt_hook (lua_State *L, lua_Debug *ar);
+static void profiler_hook (lua_State *L, lua_Debug *ar);
 static void interrupt_init (lua_State *L)
 {
     lua_sethook(L, interrupt_hook, LUA_MASKCOUNT, 256);
@@ -372,6 +380,10 @@ static void interrupt_init (lua_State *L)
 
 static void interrupt_hook (lua_State *L, lua_Debug *ar)
 {
+    // Lets the native sampling profiler name the running Lua function
+    if (profiler_lua_wanted.load(std::memory_order_relaxed))
+        profiler_publishLua(L, ar);
+
     if (lstop)
     {
         lstop = 0;
@@ -383,7 +395,7 @@ static void interrupt_hook (lua_State *L, lua_Debug *ar)
 bool DFHack::Lua::Interrupt (bool force)
 {
     lua_State *L = Lua::Core::State;
-    if (L->hook != interrupt_hook && !force)
+    if (L->hook != interrupt_hook && L->hook != profiler_hook && !force)
         return false;
     if (force)
         lua_sethook(L, interrupt_hook, LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE | LUA_MASKCOUNT, 1);
@@ -391,6 +403,448 @@ bool DFHack::Lua::Interrupt (bool force)
     return true;
 }
 
+/*
+ * Native profiler
+ *
+ * Replaces the interrupt hook of the core context while it runs. Functions
+ * are keyed by their prototype, C closure or light C function pointer, so
+ * the hook never touches the Lua stack except for the first sighting of each
+ * function, when the function is also anchored in the registry until stop.
+ */
+
+namespace {
+    struct prof_function {
+        const void *key;
+        std::string name, source, what;
+        int line;
+        uint64_t calls;
+        double self, total;
+        int active;
+        uint64_t stamp;
+    };
+
+    struct prof_node {
+        int parent;
+        int func;
+        double self;
+    };
+
+    struct prof_frame {
+        ptrdiff_t base;
+        int func;
+        int node;
+        double start, child, overhead;
+    };
+
+    typedef std::vector<prof_frame> prof_stack;
+}
+
+static struct {
+    bool running;
+    bool tracing;
+    int period;
+    global_State *g;
+    double started, elapsed;
+    double overhead;
+    uint64_t samples;
+
+    std::unordered_map<const void*, int> by_key;
+    std::vector<prof_function> functions;
+    std::unordered_map<uint64_t, int> edges;
+    std::vector<prof_node> nodes;
+
+    std::unordered_map<lua_State*, prof_stack> stacks;
+    lua_State *last_thread;
+    prof_stack *last_stack;
+} profiler;
+
+static int DFHACK_PROFILER_ANCHOR_TOKEN = 0;
+
+static double profiler_clock()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static const void *profiler_key(CallInfo *ci)
+{
+    StkId func = ci->func;
+    if (ttisLclosure(func))
+        return clLvalue(func)->p;
+    if (ttislcf(func))
+        return (const void*)fvalue(func);
+    // Wrapped API functions all share one C function (meta_call_function),
+    // so C closures are told apart by the closure object, which the anchor
+    // table keeps alive until stop.
+    if (ttisCclosure(func))
+        return (const void*)clCvalue(func);
+    return NULL;
+}
+
+// Folded stacks use ';' between frames and a newline between stacks.
+static std::string profiler_sanitize(const char *str)
+{
+    std::string rv(str ? str : "?");
+    for (size_t i = 0; i < rv.size(); i++)
+        if (rv[i] == ';' || rv[i] == '\n' || rv[i] == '\r')
+            rv[i] = '_';
+    return rv;
+}
+
+static int profiler_function(lua_State *L, CallInfo *ci, int level)
+{
+    const void *key = profiler_key(ci);
+    auto it = profiler.by_key.find(key);
+    if (it != profiler.by_key.end())
+        return it->second;
+
+    prof_function fn;
+    fn.key = key;
+    fn.line = -1;
+    fn.calls = 0;
+    fn.self = fn.total = 0;
+    fn.active = 0;
+    fn.stamp = 0;
+
+    int idx = int(profiler.functions.size());
+
+    lua_Debug ar;
+    if (lua_getstack(L, level, &ar) && lua_getinfo(L, "Snf", &ar))
+    {
+        // Keep the function alive until stop, so that its prototype
+        // cannot be freed and the address reused by another function.
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &DFHACK_PROFILER_ANCHOR_TOKEN);
+        if (lua_istable(L, -1))
+        {
+            lua_pushvalue(L, -2);
+            lua_rawseti(L, -2, idx+1);
+        }
+        lua_pop(L, 2);
+
+        fn.source = profiler_sanitize(ar.short_src);
+        fn.what = ar.what;
+        fn.line = ar.linedefined;
+        if (ar.name)
+            fn.name = profiler_sanitize(ar.name);
+    }
+    else
+    {
+        fn.source = "?";
+        fn.what = "?";
+    }
+
+    if (fn.name.empty())
+    {
+        if (fn.what == "C")
+            fn.name = stl_sprintf("%p", key);
+        else
+            fn.name = fn.what == "main" ? "main" : "?";
+    }
+
+    profiler.functions.push_back(fn);
+    profiler.by_key[key] = idx;
+    return idx;
+}
+
+static int profiler_child(int parent, int func)
+{
+    uint64_t edge = (uint64_t(uint32_t(parent + 1)) << 32) | uint32_t(func);
+    auto it = profiler.edges.find(edge);
+    if (it != profiler.edges.end())
+        return it->second;
+
+    int idx = int(profiler.nodes.size());
+    profiler.nodes.push_back({ parent, func, 0 });
+    profiler.edges[edge] = idx;
+    return idx;
+}
+
+static prof_stack &profiler_stack(lua_State *L)
+{
+    if (L != profiler.last_thread)
+    {
+        profiler.last_thread = L;
+        profiler.last_stack = &profiler.stacks[L];
+    }
+    return *profiler.last_stack;
+}
+
+static void profiler_leave(prof_stack &stack, double now)
+{
+    prof_frame frame = stack.back();
+    stack.pop_back();
+
+    double elapsed = now - frame.start - (profiler.overhead - frame.overhead);
+    double self = elapsed - frame.child;
+
+    auto &fn = profiler.functions[frame.func];
+    fn.self += self;
+    if (--fn.active == 0)
+        fn.total += elapsed;
+    profiler.nodes[frame.node].self += self;
+
+    if (!stack.empty())
+        stack.back().child += elapsed;
+}
+
+static void profiler_trace(lua_State *L, lua_Debug *ar, double now)
+{
+    auto &stack = profiler_stack(L);
+    CallInfo *ci = L->ci;
+    ptrdiff_t base = (char*)ci->func - (char*)L->stack;
+
+    if (ar->event == LUA_HOOKRET)
+    {
+        // Frames above this one were unwound by an error without a
+        // return event; close them now.
+        while (!stack.empty() && stack.back().base > base)
+            profiler_leave(stack, now);
+        if (!stack.empty() && stack.back().base == base)
+            profiler_leave(stack, now);
+        return;
+    }
+
+    // The first call in a thread means anything still recorded for it
+    // is stale; a tail call reuses the slot of the frame it replaces.
+    if (ci->previous == &L->base_ci)
+        base = -1;
+    while (!stack.empty() && stack.back().base >= base)
+        profiler_leave(stack, now);
+    if (base < 0)
+        base = (char*)ci->func - (char*)L->stack;
+
+    int func = profiler_function(L, ci, 0);
+    int parent = stack.empty() ? -1 : stack.back().node;
+
+    auto &fn = profiler.functions[func];
+    fn.calls++;
+    fn.active++;
+
+    stack.push_back({ base, func, profiler_child(parent, func), now, 0, profiler.overhead });
+}
+
+static void profiler_sample(lua_State *L)
+{
+    static int funcs[256];
+    int depth = 0;
+
+    for (CallInfo *ci = L->ci; ci && ci != &L->base_ci && depth < 256; ci = ci->previous)
+        funcs[depth] = profiler_function(L, ci, depth), depth++;
+    if (!depth)
+        return;
+
+    uint64_t stamp = ++profiler.samples;
+    profiler.functions[funcs[0]].self++;
+
+    int node = -1;
+    for (int i = depth-1; i >= 0; i--)
+    {
+        auto &fn = profiler.functions[funcs[i]];
+        if (fn.stamp != stamp)
+        {
+            fn.stamp = stamp;
+            fn.total++;
+        }
+        node = profiler_child(node, funcs[i]);
+    }
+    profiler.nodes[node].self++;
+}
+
+static void profiler_hook (lua_State *L, lua_Debug *ar)
+{
+    if (!profiler.running || G(L) != profiler.g)
+    {
+        interrupt_init(L);
+        interrupt_hook(L, ar);
+        return;
+    }
+
+    if (ar->event != LUA_HOOKCOUNT)
+    {
+        double now = profiler_clock();
+        profiler_trace(L, ar, now);
+        profiler.overhead += profiler_clock() - now;
+    }
+    else if (!profiler.tracing)
+        profiler_sample(L);
+
+    interrupt_hook(L, ar);
+}
+
+static void profiler_sethook(lua_State *L)
+{
+    if (profiler.tracing)
+        lua_sethook(L, profiler_hook, LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT, 256);
+    else
+        lua_sethook(L, profiler_hook, LUA_MASKCOUNT, profiler.period);
+}
+
+static const char *const profiler_modes[] = { "sample", "trace", NULL };
+
+static int dfhack_profiler_start(lua_State *L)
+{
+    int mode = luaL_checkoption(L, 1, "sample", profiler_modes);
+    int period = luaL_optint(L, 2, 1000);
+    if (period <= 0)
+        luaL_argerror(L, 2, "period must be positive");
+
+    if (profiler.running)
+    {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+
+    profiler.by_key.clear();
+    profiler.functions.clear();
+    profiler.edges.clear();
+    profiler.nodes.clear();
+    profiler.stacks.clear();
+    profiler.last_thread = NULL;
+    profiler.last_stack = NULL;
+
+    profiler.running = true;
+    profiler.tracing = (mode == 1);
+    profiler.period = period;
+    profiler.g = G(L);
+    profiler.samples = 0;
+    profiler.overhead = 0;
+    profiler.elapsed = 0;
+    profiler.started = profiler_clock();
+
+    lua_newtable(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &DFHACK_PROFILER_ANCHOR_TOKEN);
+
+    profiler_sethook(G(L)->mainthread);
+    if (L != G(L)->mainthread)
+        profiler_sethook(L);
+
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+static int dfhack_profiler_stop(lua_State *L)
+{
+    if (!profiler.running)
+        return 0;
+
+    // Only the calling thread and the main thread are known to be alive
+    // and running; frames left in suspended coroutines are dropped.
+    double now = profiler_clock();
+    for (lua_State *thread : { L, G(L)->mainthread })
+    {
+        auto &stack = profiler.stacks[thread];
+        while (!stack.empty())
+            profiler_leave(stack, now);
+    }
+    profiler.stacks.clear();
+    profiler.last_thread = NULL;
+    profiler.last_stack = NULL;
+
+    profiler.running = false;
+    profiler.elapsed = now - profiler.started;
+
+    lua_pushnil(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &DFHACK_PROFILER_ANCHOR_TOKEN);
+
+    // Other threads switch back on their next hook invocation.
+    interrupt_init(G(L)->mainthread);
+    interrupt_init(L);
+    return 0;
+}
+
+static int dfhack_profiler_is_running(lua_State *L)
+{
+    lua_pushboolean(L, profiler.running);
+    return 1;
+}
+
+static int dfhack_profiler_get_results(lua_State *L)
+{
+    std::vector<int> order(profiler.functions.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = int(i);
+    std::stable_sort(order.begin(), order.end(), [](int a, int b) {
+        return profiler.functions[a].self > profiler.functions[b].self;
+    });
+
+    double elapsed = profiler.running ? profiler_clock() - profiler.started : profiler.elapsed;
+
+    lua_createtable(L, 0, 6);
+    Lua::SetField(L, profiler.tracing ? "trace" : "sample", -1, "mode");
+    Lua::SetField(L, profiler.running, -1, "running");
+    Lua::SetField(L, elapsed, -1, "elapsed");
+    Lua::SetField(L, profiler.overhead, -1, "overhead");
+    Lua::SetField(L, double(profiler.samples), -1, "samples");
+
+    lua_createtable(L, int(order.size()), 0);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        auto &fn = profiler.functions[order[i]];
+        lua_createtable(L, 0, 7);
+        Lua::SetField(L, fn.name, -1, "name");
+        Lua::SetField(L, fn.source, -1, "source");
+        Lua::SetField(L, fn.line, -1, "line");
+        Lua::SetField(L, fn.what, -1, "what");
+        Lua::SetField(L, double(fn.calls), -1, "calls");
+        Lua::SetField(L, fn.self, -1, "self");
+        Lua::SetField(L, fn.total, -1, "total");
+        lua_rawseti(L, -2, int(i+1));
+    }
+    lua_setfield(L, -2, "functions");
+    return 1;
+}
+
+static int dfhack_profiler_dump_folded(lua_State *L)
+{
+    std::vector<std::string> names(profiler.functions.size());
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        auto &fn = profiler.functions[i];
+        if (fn.what == "C")
+            names[i] = fn.name + "@[C]";
+        else
+            names[i] = stl_sprintf("%s@%s:%d", fn.name.c_str(), fn.source.c_str(), fn.line);
+    }
+
+    luaL_Buffer buf;
+    luaL_buffinit(L, &buf);
+
+    std::vector<int> path;
+    for (size_t i = 0; i < profiler.nodes.size(); i++)
+    {
+        // Tracing weights are whole microseconds, as flamegraph expects.
+        double weight = profiler.nodes[i].self;
+        if (profiler.tracing)
+            weight *= 1e6;
+        if (weight < 1)
+            continue;
+
+        path.clear();
+        for (int node = int(i); node >= 0; node = profiler.nodes[node].parent)
+            path.push_back(profiler.nodes[node].func);
+
+        for (size_t j = path.size(); j > 0; j--)
+        {
+            luaL_addstring(&buf, names[path[j-1]].c_str());
+            luaL_addchar(&buf, j > 1 ? ';' : ' ');
+        }
+        std::string count = stl_sprintf("%llu\n", (unsigned long long)weight);
+        luaL_addstring(&buf, count.c_str());
+    }
+
+    luaL_pushresult(&buf);
+    return 1;
+}
+
+static const luaL_Reg dfhack_profiler_funcs[] = {
+    { "start", dfhack_profiler_start },
+    { "stop", dfhack_profiler_stop },
+    { "isRunning", dfhack_profiler_is_running },
+    { "getResults", dfhack_profiler_get_results },
+    { "dumpFolded", dfhack_profiler_dump_folded },
+    { NULL, NULL }
+};
+
 static int DFHACK_EXCEPTION_META_TOKEN = 0;
 
 static void error_tostring(lua_State *L, bool keep_old = false)
@@ -1730,10 +2184,157 @@ lua_State *DFHack::Lua::Open(color_ostream &out, lua_State *state)
     return state;
 }
 
+/*
+ * Hashed timing wheel holding the pending timer ids of one dfhack.timeout
+ * clock. Each timer is linked into the slot of its deadline modulo the wheel
+ * size, so scheduling and cancelling are O(1); timers more than one turn of
+ * the wheel away simply stay in their slot until a pass finds them due.
+ */
+class timer_wheel
+{
+    static const int num_slots = 1024;
+
+    struct node {
+        int id;
+        int deadline;
+        int prev, next;
+    };
+
+    std::vector<node> nodes;
+    std::vector<int> free_nodes;
+    std::unordered_map<int,int> by_id;
+    int slots[num_slots];
+    int current;
+
+    static int slot_of(int time) { return int(unsigned(time) % num_slots); }
+
+    void unlink(int idx)
+    {
+        node &n = nodes[idx];
+        if (n.prev >= 0)
+            nodes[n.prev].next = n.next;
+        else
+            slots[slot_of(n.deadline)] = n.next;
+        if (n.next >= 0)
+            nodes[n.next].prev = n.prev;
+        by_id.erase(n.id);
+        free_nodes.push_back(idx);
+    }
+
+    void collect(int slot, int bound, std::vector<std::pair<int,int> > &due)
+    {
+        for (int idx = slots[slot]; idx >= 0; )
+        {
+            int next = nodes[idx].next;
+            if (nodes[idx].deadline <= bound)
+            {
+                due.push_back(std::make_pair(nodes[idx].deadline, nodes[idx].id));
+                unlink(idx);
+            }
+            idx = next;
+        }
+    }
+
+public:
+    timer_wheel() : current(0) { clear(); }
+
+    size_t size() const { return by_id.size(); }
+    bool empty() const { return by_id.empty(); }
+
+    void clear()
+    {
+        nodes.clear();
+        free_nodes.clear();
+        by_id.clear();
+        std::fill(slots, slots+num_slots, -1);
+    }
+
+    void ids(std::vector<int> &out) const
+    {
+        for (auto it = by_id.begin(); it != by_id.end(); ++it)
+            out.push_back(it->first);
+    }
+
+    void schedule(int id, int now, int deadline)
+    {
+        if (empty())
+            current = now;
+        // never link behind the last processed time, or it would wait a full turn
+        if (deadline <= current)
+            deadline = current+1;
+
+        int idx;
+        if (free_nodes.empty())
+        {
+            idx = nodes.size();
+            nodes.push_back(node());
+        }
+        else
+        {
+            idx = free_nodes.back();
+            free_nodes.pop_back();
+        }
+
+        int slot = slot_of(deadline);
+        node &n = nodes[idx];
+        n.id = id;
+        n.deadline = deadline;
+        n.prev = -1;
+        n.next = slots[slot];
+        if (n.next >= 0)
+            nodes[n.next].prev = idx;
+        slots[slot] = idx;
+        by_id[id] = idx;
+    }
+
+    bool cancel(int id)
+    {
+        auto it = by_id.find(id);
+        if (it == by_id.end())
+            return false;
+        unlink(it->second);
+        return true;
+    }
+
+    // Removes the ids of all timers due at or before bound, in deadline and
+    // then scheduling order.
+    void advance(int bound, std::vector<int> &out)
+    {
+        if (empty() || bound <= current)
+        {
+            if (empty())
+                current = bound;
+            return;
+        }
+
+        std::vector<std::pair<int,int> > due;
+        if (bound - current >= num_slots)
+        {
+            for (int slot = 0; slot < num_slots; slot++)
+                collect(slot, bound, due);
+        }
+        else
+        {
+            for (int time = current+1; time <= bound; time++)
+                collect(slot_of(time), bound, due);
+        }
+        current = bound;
+
+        std::sort(due.begin(), due.end());
+        for (size_t i = 0; i < due.size(); i++)
+            out.push_back(due[i].second);
+    }
+};
+
 static int next_timeout_id = 0;
 static int frame_idx = 0;
-static std::multimap<int,int> frame_timers;
-static std::multimap<int,int> tick_timers;
+static timer_wheel frame_timers;
+static timer_wheel tick_timers;
+
+static struct {
+    size_t dispatched;
+    double last_ms, max_ms;
+} timer_stats;
 
 int DFHACK_TIMEOUTS_TOKEN = 0;
 
@@ -1781,9 +2382,9 @@ int dfhack_timeout(lua_State *L)
     // Queue the timeout
     int id = next_timeout_id++;
     if (mode)
-        tick_timers.insert(std::pair<int,int>(world->frame_counter+delta, id));
+        tick_timers.schedule(id, world->frame_counter, world->frame_counter+delta);
     else
-        frame_timers.insert(std::pair<int,int>(frame_idx+delta, id));
+        frame_timers.schedule(id, frame_idx, frame_idx+delta);
 
     lua_rawgetp(L, LUA_REGISTRYINDEX, &DFHACK_TIMEOUTS_TOKEN);
     lua_swap(L);
@@ -1793,6 +2394,17 @@ int dfhack_timeout(lua_State *L)
     return 1;
 }
 
+static void cancel_timer(lua_State *L, int id)
+{
+    if (!frame_timers.cancel(id))
+        tick_timers.cancel(id);
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &DFHACK_TIMEOUTS_TOKEN);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, id);
+    lua_pop(L, 1);
+}
+
 int dfhack_timeout_active(lua_State *L)
 {
     int id = luaL_optint(L, 1, -1);
@@ -1811,23 +2423,61 @@ int dfhack_timeout_active(lua_State *L)
     lua_rawgeti(L, 3, id);
     if (set_cb && !lua_isnil(L, -1))
     {
-        lua_pushvalue(L, 2);
-        lua_rawseti(L, 3, id);
+        if (lua_isnil(L, 2))
+            cancel_timer(L, id);
+        else
+        {
+            lua_pushvalue(L, 2);
+            lua_rawseti(L, 3, id);
+        }
     }
     return 1;
 }
 
-static void cancel_timers(std::multimap<int,int> &timers)
+int dfhack_timeout_cancel(lua_State *L)
+{
+    int id = luaL_optint(L, 1, -1);
+    if (id < 0)
+    {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &DFHACK_TIMEOUTS_TOKEN);
+    lua_rawgeti(L, -1, id);
+    bool active = !lua_isnil(L, -1);
+    lua_pop(L, 2);
+
+    if (active)
+        cancel_timer(L, id);
+    lua_pushboolean(L, active);
+    return 1;
+}
+
+int dfhack_timeout_stats(lua_State *L)
+{
+    lua_createtable(L, 0, 5);
+    Lua::SetField(L, int(frame_timers.size()), -1, "frame_timers");
+    Lua::SetField(L, int(tick_timers.size()), -1, "tick_timers");
+    Lua::SetField(L, double(timer_stats.dispatched), -1, "dispatched");
+    Lua::SetField(L, timer_stats.last_ms, -1, "last_dispatch_ms");
+    Lua::SetField(L, timer_stats.max_ms, -1, "max_dispatch_ms");
+    return 1;
+}
+
+static void cancel_timers(timer_wheel &timers)
 {
     using Lua::Core::State;
 
     Lua::StackUnwinder frame(State);
     lua_rawgetp(State, LUA_REGISTRYINDEX, &DFHACK_TIMEOUTS_TOKEN);
 
-    for (auto it = timers.begin(); it != timers.end(); ++it)
+    std::vector<int> ids;
+    timers.ids(ids);
+    for (size_t i = 0; i < ids.size(); i++)
     {
         lua_pushnil(State);
-        lua_rawseti(State, frame[1], it->second);
+        lua_rawseti(State, frame[1], ids[i]);
     }
 
     timers.clear();
@@ -1850,13 +2500,22 @@ void DFHack::Lua::Core::onStateChange(color_ostream &out, int code) {
     Lua::Event::Invoke(out, State, (void*)onStateChange, 1);
 }
 
-static void run_timers(color_ostream &out, lua_State *L,
-                       std::multimap<int,int> &timers, int table, int bound)
+struct timer_batch {
+    std::vector<int> ids;
+    size_t next;
+};
+
+// Runs the callbacks of a batch of due timers in one protected call. If a
+// callback fails, the caller resumes the batch after it.
+static int dispatch_timer_batch(lua_State *L)
 {
-    while (!timers.empty() && timers.begin()->first <= bound)
+    auto batch = (timer_batch*)lua_touserdata(L, 1);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &DFHACK_TIMEOUTS_TOKEN);
+    int table = lua_gettop(L);
+
+    while (batch->next < batch->ids.size())
     {
-        int id = timers.begin()->second;
-        timers.erase(timers.begin());
+        int id = batch->ids[batch->next++];
 
         lua_rawgeti(L, table, id);
 
@@ -1867,9 +2526,27 @@ static void run_timers(color_ostream &out, lua_State *L,
             lua_pushnil(L);
             lua_rawseti(L, table, id);
 
-            Lua::SafeCall(out, L, 0, 0);
+            timer_stats.dispatched++;
+            lua_call(L, 0, 0);
         }
     }
+
+    return 0;
+}
+
+static void run_timers(color_ostream &out, lua_State *L,
+                       timer_wheel &timers, int bound)
+{
+    timer_batch batch;
+    batch.next = 0;
+    timers.advance(bound, batch.ids);
+
+    while (batch.next < batch.ids.size())
+    {
+        lua_pushcfunction(L, dispatch_timer_batch);
+        lua_pushlightuserdata(L, &batch);
+        Lua::SafeCall(out, L, 1, 0);
+    }
 }
 
 void DFHack::Lua::Core::onUpdate(color_ostream &out)
@@ -1879,13 +2556,16 @@ void DFHack::Lua::Core::onUpdate(color_ostream &out)
     if (frame_timers.empty() && tick_timers.empty())
         return;
 
+    auto start = std::chrono::steady_clock::now();
     Lua::StackUnwinder frame(State);
-    lua_rawgetp(State, LUA_REGISTRYINDEX, &DFHACK_TIMEOUTS_TOKEN);
 
-    run_timers(out, State, frame_timers, frame[1], ++frame_idx);
+    run_timers(out, State, frame_timers, ++frame_idx);
 
     if (world)
-        run_timers(out, State, tick_timers, frame[1], world->frame_counter);
+        run_timers(out, State, tick_timers, world->frame_counter);
+
+    timer_stats.last_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    timer_stats.max_ms = std::max(timer_stats.max_ms, timer_stats.last_ms);
 }
 
 bool DFHack::Lua::Core::Init(color_ostream &out)
@@ -1916,6 +2596,14 @@ static void Lua::Core::InitCoreContext()
     lua_setfield(State, -2, "timeout");
     lua_pushcfunction(State, dfhack_timeout_active);
     lua_setfield(State, -2, "timeout_active");
+    lua_pushcfunction(State, dfhack_timeout_cancel);
+    lua_setfield(State, -2, "timeout_cancel");
+    lua_pushcfunction(State, dfhack_timeout_stats);
+    lua_setfield(State, -2, "timeout_stats");
+
+    lua_newtable(State);
+    luaL_setfuncs(State, dfhack_profiler_funcs, 0);
+    lua_setfield(State, -2, "profiler");
 
     lua_pop(State, 1);
 }
@@ -43,7 +43,14 @@ distribution.
 
 using namespace DFHack;
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <map>
 using namespace std;
@@ -197,6 +204,8 @@ Plugin::Plugin(Core * core, const std::string & path,
     plugin_rpcconnect = 0;
     plugin_enable = 0;
     plugin_is_enabled = 0;
+    load_time_open = 0;
+    load_time_init = 0;
     state = PS_UNLOADED;
     access = new RefLock();
 }
@@ -230,22 +239,53 @@ const char *Plugin::getStateDescription (plugin_state state)
 
 bool Plugin::load(color_ostream &con)
 {
-    {
-        RefAutolock lock(access);
-        if(state == PS_LOADED)
-        {
-            return true;
-        }
-        else if(state != PS_UNLOADED && state != PS_DELETED)
-        {
-            if (state == PS_BROKEN)
-                con.printerr("Plugin %s is broken - cannot be loaded\n", name.c_str());
-            return false;
-        }
-        state = PS_LOADING;
-    }
+    if (!begin_load(con))
+        return state == PS_LOADED;
     // enter suspend
     CoreSuspender suspend;
+    auto start = std::chrono::steady_clock::now();
+    DFLibrary * plug = open_library(con);
+    if (!plug)
+        return false;
+    auto opened = std::chrono::steady_clock::now();
+    bool ok = finish_load(con, plug);
+    record_load_time(opened - start, std::chrono::steady_clock::now() - opened);
+    return ok;
+}
+
+bool Plugin::begin_load(color_ostream &con)
+{
+    RefAutolock lock(access);
+    if(state == PS_LOADED)
+    {
+        return false;
+    }
+    else if(state != PS_UNLOADED && state != PS_DELETED)
+    {
+        if (state == PS_BROKEN)
+            con.printerr("Plugin %s is broken - cannot be loaded\n", name.c_str());
+        return false;
+    }
+    state = PS_LOADING;
+    return true;
+}
+
+#define plugin_abort_load ClosePlugin(plug); RefAutolock lock(access); state = PS_UNLOADED
+#define plugin_check_symbol(sym) \
+    if (!LookupPlugin(plug, sym)) \
+    { \
+        con.printerr("Plugin %s: missing symbol: %s\n", name.c_str(), sym); \
+        plugin_abort_load; \
+        return NULL; \
+    }
+
+/*
+ * Opens the library and validates its identity. This touches nothing but
+ * this plugin and the library, so PluginManager::loadAll runs it for many
+ * plugins at once on worker threads.
+ */
+DFLibrary *Plugin::open_library(color_ostream &con)
+{
     // open the library, etc
     fprintf(stderr, "loading plugin %s\n", name.c_str());
     DFLibrary * plug = OpenPlugin(path.c_str());
@@ -256,22 +296,14 @@ bool Plugin::load(color_ostream &con)
         {
             con.printerr("Plugin %s does not exist on disk\n", name.c_str());
             state = PS_DELETED;
-            return false;
+            return NULL;
         }
         else {
             con.printerr("Can't load plugin %s\n", name.c_str());
             state = PS_UNLOADED;
-            return false;
+            return NULL;
         }
     }
-    #define plugin_abort_load ClosePlugin(plug); RefAutolock lock(access); state = PS_UNLOADED
-    #define plugin_check_symbol(sym) \
-        if (!LookupPlugin(plug, sym)) \
-        { \
-            con.printerr("Plugin %s: missing symbol: %s\n", name.c_str(), sym); \
-            plugin_abort_load; \
-            return false; \
-        }
 
     plugin_check_symbol("plugin_name")
     plugin_check_symbol("plugin_version")
@@ -284,12 +316,11 @@ bool Plugin::load(color_ostream &con)
     {
         con.printerr("Plugin %s: name mismatch, claims to be %s\n", name.c_str(), *plug_name);
         plugin_abort_load;
-        return false;
+        return NULL;
     }
     const char ** plug_version =(const char ** ) LookupPlugin(plug, "plugin_version");
     const int *plugin_abi_version = (int*) LookupPlugin(plug, "plugin_abi_version");
     const char ** plug_git_desc_ptr = (const char**) LookupPlugin(plug, "plugin_git_description");
-    Plugin **plug_self = (Plugin**)LookupPlugin(plug, "plugin_self");
     const char *dfhack_version = Version::dfhack_version();
     const char *dfhack_git_desc = Version::git_description();
     const char *plug_git_desc = plug_git_desc_ptr ? *plug_git_desc_ptr : "unknown";
@@ -298,14 +329,14 @@ bool Plugin::load(color_ostream &con)
         con.printerr("Plugin %s: ABI version mismatch (Plugin: %i, DFHack: %i)\n",
             *plug_name, *plugin_abi_version, Version::dfhack_abi_version());
         plugin_abort_load;
-        return false;
+        return NULL;
     }
     if (strcmp(dfhack_version, *plug_version) != 0)
     {
         con.printerr("Plugin %s was not built for this version of DFHack.\n"
                      "Plugin: %s, DFHack: %s\n", *plug_name, *plug_version, dfhack_version);
         plugin_abort_load;
-        return false;
+        return NULL;
     }
     if (plug_git_desc_ptr)
     {
@@ -320,8 +351,23 @@ bool Plugin::load(color_ostream &con)
     {
         con.print("Skipping dev plugin: %s\n", *plug_name);
         plugin_abort_load;
-        return false;
+        return NULL;
     }
+    return plug;
+}
+
+#undef plugin_check_symbol
+
+/*
+ * Resolves the optional entry points and runs plugin_init. Must be called
+ * with the core suspended, from one thread at a time.
+ */
+bool Plugin::finish_load(color_ostream &con, DFLibrary *plug)
+{
+    const char ** plug_name =(const char ** ) LookupPlugin(plug, "plugin_name");
+    const char ** plug_git_desc_ptr = (const char**) LookupPlugin(plug, "plugin_git_description");
+    const char *plug_git_desc = plug_git_desc_ptr ? *plug_git_desc_ptr : "unknown";
+    Plugin **plug_self = (Plugin**)LookupPlugin(plug, "plugin_self");
     *plug_self = this;
     plugin_init = (command_result (*)(color_ostream &, std::vector <PluginCommand> &)) LookupPlugin(plug, "plugin_init");
     std::vector<std::string>* plugin_globals = *((std::vector<std::string>**) LookupPlugin(plug, "plugin_globals"));
@@ -374,6 +420,27 @@ bool Plugin::load(color_ostream &con)
     }
 }
 
+void Plugin::abort_load(DFLibrary *plug)
+{
+    if (plug)
+        ClosePlugin(plug);
+    RefAutolock lock(access);
+    if (state == PS_LOADING)
+        state = PS_UNLOADED;
+}
+
+#undef plugin_abort_load
+
+void Plugin::record_load_time(std::chrono::steady_clock::duration open,
+                              std::chrono::steady_clock::duration init)
+{
+    typedef std::chrono::duration<double, std::milli> ms;
+    load_time_open = ms(open).count();
+    load_time_init = ms(init).count();
+    fprintf(stderr, "plugin %s: open %.1f ms, init %.1f ms\n",
+            name.c_str(), load_time_open, load_time_init);
+}
+
 bool Plugin::unload(color_ostream &con)
 {
     // get the mutex
@@ -885,17 +952,142 @@ bool PluginManager::load (const string &name)
     return p->load(core->getConsole());
 }
 
+/*
+ * Loads all plugins in hack/plugins. Opening the libraries and checking
+ * their symbols happens on a few worker threads; plugin_init runs for each
+ * plugin on this thread, in name order, with the core suspended.
+ */
 bool PluginManager::loadAll()
 {
     MUTEX_GUARD(plugin_mutex);
+    color_ostream &con = core->getConsole();
     auto files = listPlugins();
+    std::sort(files.begin(), files.end());
     bool ok = true;
-    // load all plugins in hack/plugins
+
+    struct pending_load
+    {
+        Plugin *plugin;
+        DFLibrary *lib;
+        buffered_color_ostream out;
+        std::chrono::steady_clock::time_point start, opened;
+        bool ready;
+    };
+    std::deque<pending_load> pending;
     for (auto f = files.begin(); f != files.end(); ++f)
     {
-        if (!load(*f))
+        if (!(*this)[*f] && !addPlugin(*f))
+        {
+            ok = false;
+            continue;
+        }
+        Plugin *p = (*this)[*f];
+        if (!p->begin_load(con))
+        {
+            if (p->getState() != Plugin::PS_LOADED)
+                ok = false;
+            continue;
+        }
+        pending.emplace_back();
+        pending.back().plugin = p;
+        pending.back().lib = NULL;
+        pending.back().ready = false;
+    }
+    if (pending.empty())
+        return ok;
+
+    CoreSuspender suspend;
+    auto start = std::chrono::steady_clock::now();
+
+    // Workers claim plugins in order, so the one this thread needs next is
+    // usually already open; its plugin_init then overlaps with the opening
+    // of the ones after it.
+    std::atomic<size_t> next(0);
+    std::mutex ready_mutex;
+    std::condition_variable ready_cv;
+    auto open_worker = [&] {
+        for (size_t i; (i = next++) < pending.size(); )
+        {
+            pending_load &job = pending[i];
+            job.start = std::chrono::steady_clock::now();
+            job.lib = job.plugin->open_library(job.out);
+            job.opened = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(ready_mutex);
+            job.ready = true;
+            ready_cv.notify_all();
+        }
+    };
+    size_t num_threads = std::min<size_t>(pending.size(),
+        std::max(1u, std::min(std::thread::hardware_concurrency(), 8u)));
+    std::vector<std::thread> threads;
+    size_t done = 0;
+
+    // If a plugin_init throws, stop the workers and join them before the
+    // exception leaves; destroying a joinable std::thread terminates DF.
+    struct worker_guard {
+        std::atomic<size_t> &next;
+        std::vector<std::thread> &threads;
+        std::deque<pending_load> &pending;
+        size_t &done;
+        ~worker_guard()
+        {
+            next = pending.size();
+            for (auto &t : threads)
+                if (t.joinable())
+                    t.join();
+            for (size_t i = done; i < pending.size(); i++)
+                pending[i].plugin->abort_load(pending[i].lib);
+        }
+    } guard = { next, threads, pending, done };
+
+    for (size_t i = 0; i < num_threads; i++)
+        threads.emplace_back(open_worker);
+
+    while (done < pending.size())
+    {
+        auto &job = pending[done++];
+        {
+            std::unique_lock<std::mutex> lock(ready_mutex);
+            ready_cv.wait(lock, [&job] { return job.ready; });
+        }
+
+        // replay what the worker printed, so output stays in load order
+        for (auto &frag : job.out.fragments())
+        {
+            con.color(frag.first);
+            con << frag.second;
+        }
+        con.reset_color();
+
+        if (!job.lib)
+        {
+            ok = false;
+            continue;
+        }
+        auto init_start = std::chrono::steady_clock::now();
+        if (!job.plugin->finish_load(con, job.lib))
             ok = false;
+        job.plugin->record_load_time(job.opened - job.start,
+                                     std::chrono::steady_clock::now() - init_start);
     }
+    for (auto &t : threads)
+        t.join();
+
+    // summarize, so that slow plugins stand out in stderr.log
+    std::vector<Plugin*> slowest;
+    for (auto &job : pending)
+        slowest.push_back(job.plugin);
+    std::sort(slowest.begin(), slowest.end(), [](Plugin *a, Plugin *b) {
+        return a->getLoadTime() > b->getLoadTime();
+    });
+    double total = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "loaded %d plugins in %.1f ms on %d threads; slowest:",
+            int(pending.size()), total, int(num_threads));
+    for (size_t i = 0; i < slowest.size() && i < 5; i++)
+        fprintf(stderr, " %s (%.1f ms)", slowest[i]->getName().c_str(), slowest[i]->getLoadTime());
+    fprintf(stderr, "\n");
+    fflush(stderr);
     return ok;
 }
 
@@ -27,6 +27,7 @@ distribution.
 #include <errno.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 
 #include <string>
@@ -35,10 +36,12 @@ distribution.
 #include <set>
 #include <cstdio>
 #include <cstring>
+#include <fstream>
 using namespace std;
 
 #include <md5wrapper.h>
 #include "MemAccess.h"
+#include "MiscUtils.h"
 #include "Memory.h"
 #include "VersionInfoFactory.h"
 #include "VersionInfo.h"
@@ -46,6 +49,114 @@ using namespace std;
 #include <string.h>
 using namespace DFHack;
 
+/*
+ * Hashing the whole executable takes a noticeable part of startup, so the
+ * result is remembered together with the file's identity and reused for as
+ * long as none of it changes.
+ */
+static const char *fingerprint_cache_name = "hack/fingerprint.cache";
+
+struct exe_fingerprint
+{
+    uint64_t dev, inode, size;
+    int64_t mtime_sec, mtime_nsec;
+    std::string path;
+
+    bool operator== (const exe_fingerprint &o) const
+    {
+        return dev == o.dev && inode == o.inode && size == o.size &&
+            mtime_sec == o.mtime_sec && mtime_nsec == o.mtime_nsec &&
+            path == o.path;
+    }
+};
+
+static bool get_fingerprint(const std::string &path, exe_fingerprint *fp)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+    fp->dev = st.st_dev;
+    fp->inode = st.st_ino;
+    fp->size = st.st_size;
+    fp->mtime_sec = st.st_mtim.tv_sec;
+    fp->mtime_nsec = st.st_mtim.tv_nsec;
+    fp->path = path;
+    return true;
+}
+
+// One entry per line: md5 dev inode size mtime_sec mtime_nsec path
+static bool parse_fingerprint_line(const std::string &line, std::string *md5, exe_fingerprint *fp)
+{
+    char hash[33];
+    unsigned long long dev, inode, size;
+    long long sec, nsec;
+    int path_pos = 0;
+    if (sscanf(line.c_str(), "%32s %llu %llu %llu %lld %lld %n",
+               hash, &dev, &inode, &size, &sec, &nsec, &path_pos) != 6 || !path_pos)
+        return false;
+    *md5 = hash;
+    fp->dev = dev;
+    fp->inode = inode;
+    fp->size = size;
+    fp->mtime_sec = sec;
+    fp->mtime_nsec = nsec;
+    fp->path = line.substr(path_pos);
+    return md5->size() == 32;
+}
+
+static std::string lookup_cached_md5(const exe_fingerprint &fp)
+{
+    std::ifstream in(fingerprint_cache_name);
+    std::string line, md5;
+    exe_fingerprint entry;
+    while (std::getline(in, line))
+    {
+        if (parse_fingerprint_line(line, &md5, &entry) && entry == fp)
+            return md5;
+    }
+    return "";
+}
+
+static void store_cached_md5(const exe_fingerprint &fp, const std::string &md5)
+{
+    if (md5.size() != 32 || md5.find_first_not_of("0123456789abcdef") != std::string::npos)
+        return;
+
+    // keep entries for other executables sharing this install
+    std::vector<std::string> lines;
+    {
+        std::ifstream in(fingerprint_cache_name);
+        std::string line, old_md5;
+        exe_fingerprint entry;
+        while (std::getline(in, line))
+        {
+            if (parse_fingerprint_line(line, &old_md5, &entry) && entry.path != fp.path)
+                lines.push_back(line);
+        }
+    }
+
+    // write and rename, so that concurrently starting instances never
+    // see a half-written file
+    std::string tmp_name = stl_sprintf("%s.%d", fingerprint_cache_name, int(getpid()));
+    {
+        std::ofstream out(tmp_name.c_str(), std::ios::trunc);
+        if (!out)
+            return;
+        for (auto &line : lines)
+            out << line << '\n';
+        out << md5 << ' ' << fp.dev << ' ' << fp.inode << ' ' << fp.size << ' '
+            << fp.mtime_sec << ' ' << fp.mtime_nsec << ' ' << fp.path << '\n';
+        if (!out)
+        {
+            out.close();
+            remove(tmp_name.c_str());
+            return;
+        }
+    }
+    if (rename(tmp_name.c_str(), fingerprint_cache_name) != 0)
+        remove(tmp_name.c_str());
+}
+
 Process::Process(VersionInfoFactory * known_versions)
 {
     const char * dir_name = "/proc/self/";
@@ -68,13 +179,29 @@ Process::Process(VersionInfoFactory * known_versions)
         self_exe_name = self_exe;
 
     md5wrapper md5;
-    uint32_t length;
+    uint32_t length = 0;
     uint8_t first_kb [1024];
     memset(first_kb, 0, sizeof(first_kb));
-    // get hash of the running DF process
-    my_md5 = md5.getHashFromFile(self_exe_name, length, (char *) first_kb);
-    // create linux process, add it to the vector
-    VersionInfo * vinfo = known_versions->getVersionInfoByMD5(my_md5);
+
+    exe_fingerprint fingerprint;
+    bool have_fingerprint = get_fingerprint(self_exe_name, &fingerprint);
+    bool from_cache = false;
+    if (have_fingerprint)
+    {
+        my_md5 = lookup_cached_md5(fingerprint);
+        from_cache = !my_md5.empty();
+    }
+
+    VersionInfo * vinfo = from_cache ? known_versions->getVersionInfoByMD5(my_md5) : NULL;
+    if (!vinfo)
+    {
+        // get hash of the running DF process
+        my_md5 = md5.getHashFromFile(self_exe_name, length, (char *) first_kb);
+        if (have_fingerprint)
+            store_cached_md5(fingerprint, my_md5);
+        // create linux process, add it to the vector
+        vinfo = known_versions->getVersionInfoByMD5(my_md5);
+    }
     if(vinfo)
     {
         my_descriptor = new VersionInfo(*vinfo);
@@ -0,0 +1,427 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include "Internal.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Profiler.h"
+#include "LuaTools.h"
+
+#ifdef __linux__
+#include <csignal>
+#include <ctime>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <lua.h>
+#include <lstate.h>
+#include <lobject.h>
+#endif
+
+using namespace DFHack;
+
+namespace {
+    const int MAX_DEPTH = 32;
+    const int LUA_SOURCE_LEN = 64;
+    const size_t MAX_SAMPLES = 1 << 15;
+
+    // handler frame and the signal trampoline
+    const int SKIP_FRAMES = 2;
+
+    struct Sample {
+        int depth;
+        void *pc[MAX_DEPTH];
+        int lua_line;
+        char lua_source[LUA_SOURCE_LEN];
+    };
+
+    /*
+     * The Lua function last seen running by the interrupt hook of the core
+     * state. The hook writes the slot that is not published and then bumps
+     * the sequence number; the signal handler copies the published slot and
+     * drops it if the sequence moved on by two in the meantime.
+     */
+    struct LuaSlot {
+        int line;
+        char source[LUA_SOURCE_LEN];
+    };
+
+    LuaSlot lua_slots[2];
+    std::atomic<unsigned> lua_seq(0);
+
+    // Only the sampled thread appends, so the count doubles as the commit
+    // point for readers. The vector is never resized while the timer runs.
+    std::vector<Sample> samples;
+    std::atomic<size_t> num_samples(0);
+    std::atomic<size_t> num_dropped(0);
+
+    const int NO_REQUEST = -1;
+    std::atomic<int> request(NO_REQUEST); // 0 to stop, otherwise the frequency
+
+    std::mutex state_mutex;
+    bool running = false;
+    int frequency = 0;
+}
+
+// Checked by the Lua interrupt hook before calling profiler_publishLua
+std::atomic<bool> profiler_lua_wanted(false);
+
+#ifdef __linux__
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace {
+    timer_t timer;
+    struct sigaction old_action;
+
+    /*
+     * Copies the Lua function published by the interrupt hook. The VM
+     * structures themselves are not consistent at arbitrary instructions,
+     * so the handler never looks at them.
+     */
+    void peek_lua(Sample *s)
+    {
+        s->lua_line = -1;
+        s->lua_source[0] = 0;
+
+        unsigned seq = lua_seq.load(std::memory_order_acquire);
+        if (seq == 0)
+            return;
+
+        const LuaSlot &slot = lua_slots[seq & 1];
+        memcpy(s->lua_source, slot.source, LUA_SOURCE_LEN);
+        s->lua_line = slot.line;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (lua_seq.load(std::memory_order_relaxed) - seq >= 2)
+        {
+            s->lua_line = -1;
+            s->lua_source[0] = 0;
+        }
+        s->lua_source[LUA_SOURCE_LEN-1] = 0;
+    }
+
+    void on_sigprof(int, siginfo_t *, void *)
+    {
+        int saved_errno = errno;
+
+        size_t idx = num_samples.load(std::memory_order_relaxed);
+        if (idx < samples.size())
+        {
+            Sample &s = samples[idx];
+            s.depth = backtrace(s.pc, MAX_DEPTH);
+            peek_lua(&s);
+            num_samples.store(idx+1, std::memory_order_release);
+        }
+        else
+            num_dropped.fetch_add(1, std::memory_order_relaxed);
+
+        errno = saved_errno;
+    }
+
+    bool arm_timer(int hz)
+    {
+        // backtrace() loads libgcc on first use, which is not safe to do
+        // from a signal handler.
+        void *dummy[2];
+        backtrace(dummy, 2);
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = on_sigprof;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGPROF, &sa, &old_action) != 0)
+            return false;
+
+        struct sigevent sev;
+        memset(&sev, 0, sizeof(sev));
+        sev.sigev_notify = SIGEV_THREAD_ID;
+        sev.sigev_signo = SIGPROF;
+        sev.sigev_notify_thread_id = syscall(SYS_gettid);
+
+        if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &timer) != 0)
+        {
+            sigaction(SIGPROF, &old_action, NULL);
+            return false;
+        }
+
+        struct itimerspec its;
+        long interval = 1000000000L / hz;
+        its.it_interval.tv_sec = interval / 1000000000L;
+        its.it_interval.tv_nsec = interval % 1000000000L;
+        its.it_value = its.it_interval;
+
+        if (timer_settime(timer, 0, &its, NULL) != 0)
+        {
+            timer_delete(timer);
+            sigaction(SIGPROF, &old_action, NULL);
+            return false;
+        }
+
+        return true;
+    }
+
+    void disarm_timer()
+    {
+        timer_delete(timer);
+        sigaction(SIGPROF, &old_action, NULL);
+    }
+
+    std::string frame_name(void *pc)
+    {
+        Dl_info info;
+        if (!dladdr(pc, &info) || !info.dli_fname)
+            return "[unknown]";
+
+        std::string module = info.dli_fname;
+        size_t slash = module.rfind('/');
+        if (slash != std::string::npos)
+            module = module.substr(slash+1);
+
+        if (info.dli_sname)
+        {
+            int status = 0;
+            char *demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+            std::string name = (status == 0 && demangled) ? demangled : info.dli_sname;
+            free(demangled);
+            return module + "`" + name;
+        }
+
+        char buf[32];
+        snprintf(buf, sizeof(buf), "+0x%lx", (unsigned long)((char*)pc - (char*)info.dli_fbase));
+        return module + "`" + buf;
+    }
+
+    bool is_lua_module(const std::string &frame)
+    {
+        return frame.compare(0, 6, "liblua") == 0;
+    }
+}
+
+// Called from the interrupt hook, where the running function is consistent
+void profiler_publishLua(lua_State *L, lua_Debug *ar)
+{
+    if (!Lua::Core::State || G(L) != G(Lua::Core::State))
+        return;
+    if (!lua_getinfo(L, "S", ar) || !ar->source)
+        return;
+
+    unsigned seq = lua_seq.load(std::memory_order_relaxed) + 1;
+    LuaSlot &slot = lua_slots[seq & 1];
+
+    // keep the end of long paths
+    const char *src = ar->source;
+    size_t len = strlen(src);
+    if (len >= size_t(LUA_SOURCE_LEN))
+    {
+        src += len - (LUA_SOURCE_LEN - 1);
+        len = LUA_SOURCE_LEN - 1;
+    }
+    memcpy(slot.source, src, len);
+    slot.source[len] = 0;
+    slot.line = ar->linedefined;
+
+    lua_seq.store(seq, std::memory_order_release);
+}
+
+bool Profiler::isSupported()
+{
+    return true;
+}
+
+#else
+
+namespace {
+    bool arm_timer(int) { return false; }
+    void disarm_timer() {}
+    std::string frame_name(void *) { return "[unknown]"; }
+    bool is_lua_module(const std::string &) { return false; }
+}
+
+void profiler_publishLua(lua_State *, lua_Debug *) {}
+
+bool Profiler::isSupported()
+{
+    return false;
+}
+
+#endif
+
+bool Profiler::start(int hz)
+{
+    if (!isSupported() || hz <= 0 || hz > 100000)
+        return false;
+
+    request = hz;
+    return true;
+}
+
+void Profiler::stop()
+{
+    request = 0;
+}
+
+bool Profiler::isRunning()
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    return running;
+}
+
+int Profiler::getFrequency()
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    return frequency;
+}
+
+size_t Profiler::getSampleCount()
+{
+    return num_samples.load(std::memory_order_acquire);
+}
+
+size_t Profiler::getDroppedCount()
+{
+    return num_dropped.load(std::memory_order_relaxed);
+}
+
+// Called by Core::Update on the main thread
+void profiler_onUpdate()
+{
+    int req = request.exchange(NO_REQUEST);
+    if (req == NO_REQUEST)
+        return;
+
+    std::lock_guard<std::mutex> lock(state_mutex);
+
+    if (running)
+    {
+        disarm_timer();
+        running = false;
+        profiler_lua_wanted = false;
+    }
+
+    if (req > 0)
+    {
+        samples.resize(MAX_SAMPLES);
+        num_samples = 0;
+        num_dropped = 0;
+        lua_seq = 0;
+
+        running = arm_timer(req);
+        frequency = running ? req : 0;
+        profiler_lua_wanted = running;
+    }
+}
+
+static std::string lua_frame_name(const Sample &s)
+{
+    // Script files have an '@' prefix; chunks from strings are their text,
+    // which must not break the one-stack-per-line format.
+    const char *src = s.lua_source;
+    if (*src == '@' || *src == '=')
+        src++;
+
+    std::string name = src;
+    for (size_t i = 0; i < name.size(); i++)
+        if (name[i] == ';' || (unsigned char)name[i] < ' ')
+            name[i] = ' ';
+
+    return name + ":" + std::to_string(s.lua_line);
+}
+
+bool Profiler::writeFolded(std::ostream &out)
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+
+    size_t count = num_samples.load(std::memory_order_acquire);
+    std::unordered_map<void*, std::string> names;
+    std::map<std::string, size_t> stacks;
+
+    auto name_of = [&](void *pc) -> const std::string & {
+        auto it = names.find(pc);
+        if (it == names.end())
+            it = names.insert(std::make_pair(pc, frame_name(pc))).first;
+        return it->second;
+    };
+
+    std::string line;
+    for (size_t i = 0; i < count; i++)
+    {
+        const Sample &s = samples[i];
+        int first = std::min(SKIP_FRAMES, s.depth);
+
+        // The Lua function sits just leafward of the innermost VM frame.
+        // The published function may be stale, so without a VM frame on
+        // the stack it is not shown.
+        int lua_at = -1;
+        if (s.lua_line >= 0)
+        {
+            for (int j = first; j < s.depth; j++)
+            {
+                if (is_lua_module(name_of(s.pc[j])))
+                {
+                    lua_at = j;
+                    break;
+                }
+            }
+        }
+
+        line.clear();
+        for (int j = s.depth-1; j >= first; j--)
+        {
+            if (!line.empty())
+                line += ';';
+            line += name_of(s.pc[j]);
+
+            if (j == lua_at)
+                line += ";lua`" + lua_frame_name(s);
+        }
+
+        if (!line.empty())
+            stacks[line]++;
+    }
+
+    for (auto it = stacks.begin(); it != stacks.end(); ++it)
+        out << it->first << ' ' << it->second << '\n';
+
+    out.flush();
+    return out.good();
+}
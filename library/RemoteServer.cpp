@@ -57,6 +57,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <sstream>
 
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "json/json.h"
 #include "tinythread.h"
@@ -127,6 +129,80 @@ void RPCService::dumpMethods(std::ostream & out) const
     }
 }
 
+/*
+ * Replies of SF_SNAPSHOT functions, shared by all connections. Each is
+ * tagged with the world generation it was computed in; the main thread
+ * advances the generation whenever a world is loaded or unloaded.
+ */
+
+namespace {
+    struct rpc_snapshot {
+        unsigned generation;
+        std::shared_ptr<const std::string> data;
+    };
+}
+
+static const size_t max_snapshot_bytes = 64 << 20;
+
+static std::mutex snapshot_mutex;
+static std::unordered_map<std::string, rpc_snapshot> snapshots;
+static size_t snapshot_bytes = 0;
+static unsigned snapshot_generation = 0;
+
+void rpc_onStateChange(state_change_event event)
+{
+    if (event != SC_WORLD_LOADED && event != SC_WORLD_UNLOADED)
+        return;
+
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    snapshot_generation++;
+    snapshots.clear();
+    snapshot_bytes = 0;
+}
+
+static std::shared_ptr<const std::string> find_snapshot(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    auto it = snapshots.find(key);
+    if (it == snapshots.end() || it->second.generation != snapshot_generation)
+        return nullptr;
+    return it->second.data;
+}
+
+// Must be called under suspend, so that the generation matches the data
+// the reply was computed from.
+static std::shared_ptr<const std::string> add_snapshot(const std::string &key, const MessageLite *reply)
+{
+    auto data = std::make_shared<std::string>();
+    reply->SerializeToString(data.get());
+
+    std::lock_guard<std::mutex> lock(snapshot_mutex);
+    if (snapshot_bytes + data->size() > max_snapshot_bytes)
+    {
+        snapshots.clear();
+        snapshot_bytes = 0;
+    }
+
+    auto &entry = snapshots[key];
+    if (entry.data)
+        snapshot_bytes -= entry.data->size();
+    entry.generation = snapshot_generation;
+    entry.data = data;
+    snapshot_bytes += data->size();
+    return data;
+}
+
+static bool sendRawReply(CSimpleSocket *socket, const std::string &data)
+{
+    RPCMessageHeader header;
+    header.id = RPC_REPLY_RESULT;
+    header.size = int32_t(data.size());
+
+    std::string buf((const char*)&header, sizeof(header));
+    buf += data;
+    return socket->Send((uint8_t*)&buf[0], buf.size()) == int32_t(buf.size());
+}
+
 ServerConnection::ServerConnection(CActiveSocket *socket)
     : socket(socket), stream(this)
 {
@@ -295,6 +371,7 @@ void ServerConnection::threadFn()
 
         ServerFunctionBase *fn = vector_get(functions, header.id);
         MessageLite *reply = NULL;
+        std::shared_ptr<const std::string> snapshot;
         command_result res = CR_FAILURE;
 
         if (!fn)
@@ -311,6 +388,24 @@ void ServerConnection::threadFn()
             {
                 stream.printerr("In call to %s: could not decode input args.\n", fn->name);
             }
+            else if (fn->flags & SF_SNAPSHOT)
+            {
+                auto holder = fn->owner->holder;
+                std::string key = (holder ? holder->getName() : std::string()) + ':' + fn->name + ':';
+                key.append((const char*)buf.get(), header.size);
+                buf.reset();
+
+                snapshot = find_snapshot(key);
+                if (snapshot)
+                    res = CR_OK;
+                else
+                {
+                    CoreSuspender suspend;
+                    res = fn->execute(stream);
+                    if (res == CR_OK)
+                        snapshot = add_snapshot(key, fn->out());
+                }
+            }
             else
             {
                 buf.reset();
@@ -336,7 +431,7 @@ void ServerConnection::threadFn()
         //out.print("Answer %d:%d\n", res, reply);
 
         // Send reply
-        int out_size = (reply ? reply->ByteSize() : 0);
+        int out_size = (snapshot ? int(snapshot->size()) : reply ? reply->ByteSize() : 0);
 
         if (out_size > RPCMessageHeader::MAX_MESSAGE_SIZE)
         {
@@ -347,7 +442,15 @@ void ServerConnection::threadFn()
 
         stream.flush();
 
-        if (res == CR_OK && reply)
+        if (res == CR_OK && snapshot)
+        {
+            if (!sendRawReply(socket, *snapshot))
+            {
+                out.printerr("In RPC server: I/O error in send result.\n");
+                break;
+            }
+        }
+        else if (res == CR_OK && reply)
         {
             if (!sendRemoteMessage(socket, RPC_REPLY_RESULT, reply, true))
             {
@@ -676,7 +676,7 @@ CoreService::CoreService() :
     addFunction("ListEnums", ListEnums, SF_CALLED_ONCE | SF_DONT_SUSPEND | SF_ALLOW_REMOTE);
     addFunction("ListJobSkills", ListJobSkills, SF_CALLED_ONCE | SF_DONT_SUSPEND | SF_ALLOW_REMOTE);
 
-    addFunction("ListMaterials", ListMaterials, SF_CALLED_ONCE | SF_ALLOW_REMOTE);
+    addFunction("ListMaterials", ListMaterials, SF_CALLED_ONCE | SF_ALLOW_REMOTE | SF_SNAPSHOT);
     addFunction("ListUnits", ListUnits, SF_ALLOW_REMOTE);
     addFunction("ListSquads", ListSquads, SF_ALLOW_REMOTE);
 
@@ -43,6 +43,7 @@ using namespace DFHack;
 VersionInfoFactory::VersionInfoFactory()
 {
     error = false;
+    doc = NULL;
 }
 
 VersionInfoFactory::~VersionInfoFactory()
@@ -58,15 +59,35 @@ void VersionInfoFactory::clear()
         delete versions[i];
     }
     versions.clear();
+    pending.clear();
+    delete doc;
+    doc = NULL;
     error = false;
 }
 
+VersionInfo * VersionInfoFactory::getVersion(size_t index)
+{
+    if (index >= versions.size())
+        return NULL;
+    // symbol tables are only parsed in full for the version actually used
+    if (pending[index])
+    {
+        TiXmlElement *entry = pending[index];
+        pending[index] = NULL;
+        VersionInfo *mem = new VersionInfo();
+        ParseVersion(entry, mem);
+        delete versions[index];
+        versions[index] = mem;
+    }
+    return versions[index];
+}
+
 VersionInfo * VersionInfoFactory::getVersionInfoByMD5(string hash)
 {
     for(size_t i = 0; i < versions.size();i++)
     {
         if(versions[i]->hasMD5(hash))
-            return versions[i];
+            return getVersion(i);
     }
     return 0;
 }
@@ -76,12 +97,12 @@ VersionInfo * VersionInfoFactory::getVersionInfoByPETimestamp(uintptr_t timestam
     for(size_t i = 0; i < versions.size();i++)
     {
         if(versions[i]->hasPE(timestamp))
-            return versions[i];
+            return getVersion(i);
     }
     return 0;
 }
 
-void VersionInfoFactory::ParseVersion (TiXmlElement* entry, VersionInfo* mem)
+void VersionInfoFactory::ParseVersion (TiXmlElement* entry, VersionInfo* mem, bool ids_only)
 {
     bool no_vtables = getenv("DFHACK_NO_VTABLES");
     bool no_globals = getenv("DFHACK_NO_GLOBALS");
@@ -128,6 +149,8 @@ void VersionInfoFactory::ParseVersion (TiXmlElement* entry, VersionInfo* mem)
         const char *cstr_type = pMemEntry->Value();
         type = cstr_type;
         bool is_vtable = (type == "vtable-address");
+        if(ids_only && (is_vtable || type == "global-address"))
+            continue;
         if(is_vtable || type == "global-address")
         {
             const char *cstr_key = pMemEntry->Attribute("name");
@@ -166,7 +189,8 @@ void VersionInfoFactory::ParseVersion (TiXmlElement* entry, VersionInfo* mem)
         else if (type == "md5-hash")
         {
             const char *cstr_value = pMemEntry->Attribute("value");
-            fprintf(stderr, "%s (%s): MD5: %s\n", cstr_name, cstr_os, cstr_value);
+            if(ids_only)
+                fprintf(stderr, "%s (%s): MD5: %s\n", cstr_name, cstr_os, cstr_value);
             if(!cstr_value)
                 throw Error::SymbolsXmlUnderspecifiedEntry(cstr_name);
             mem->addMD5(cstr_value);
@@ -174,7 +198,8 @@ void VersionInfoFactory::ParseVersion (TiXmlElement* entry, VersionInfo* mem)
         else if (type == "binary-timestamp")
         {
             const char *cstr_value = pMemEntry->Attribute("value");
-            fprintf(stderr, "%s (%s): PE: %s\n", cstr_name, cstr_os, cstr_value);
+            if(ids_only)
+                fprintf(stderr, "%s (%s): PE: %s\n", cstr_name, cstr_os, cstr_value);
             if(!cstr_value)
                 throw Error::SymbolsXmlUnderspecifiedEntry(cstr_name);
             mem->addPE(strtol(cstr_value, 0, 16));
@@ -185,20 +210,21 @@ void VersionInfoFactory::ParseVersion (TiXmlElement* entry, VersionInfo* mem)
 // load the XML file with offsets
 bool VersionInfoFactory::loadFile(string path_to_xml)
 {
-    TiXmlDocument doc( path_to_xml.c_str() );
+    clear();
+    doc = new TiXmlDocument( path_to_xml.c_str() );
     std::cerr << "Loading " << path_to_xml << " ... ";
-    //bool loadOkay = doc.LoadFile();
-    if (!doc.LoadFile())
+    //bool loadOkay = doc->LoadFile();
+    if (!doc->LoadFile())
     {
         error = true;
         cerr << "failed!\n";
-        throw Error::SymbolsXmlParse(doc.ErrorDesc(), doc.ErrorId(), doc.ErrorRow(), doc.ErrorCol());
+        throw Error::SymbolsXmlParse(doc->ErrorDesc(), doc->ErrorId(), doc->ErrorRow(), doc->ErrorCol());
     }
     else
     {
         cerr << "OK\n";
     }
-    TiXmlHandle hDoc(&doc);
+    TiXmlHandle hDoc(doc);
     TiXmlElement* pElem;
     TiXmlHandle hRoot(0);
 
@@ -222,8 +248,8 @@ bool VersionInfoFactory::loadFile(string path_to_xml)
     }
     // transform elements
     {
-        clear();
-        // For each version
+        // For each version; only the identifiers are read here, and the
+        // element is kept around for getVersion to parse the symbols later
         TiXmlElement * pMemInfo=hRoot.FirstChild( "symbol-table" ).Element();
         for( ; pMemInfo; pMemInfo=pMemInfo->NextSiblingElement("symbol-table"))
         {
@@ -231,8 +257,9 @@ bool VersionInfoFactory::loadFile(string path_to_xml)
             if(name)
             {
                 VersionInfo *version = new VersionInfo();
-                ParseVersion( pMemInfo , version );
+                ParseVersion( pMemInfo , version, true );
                 versions.push_back(version);
+                pending.push_back(pMemInfo);
             }
         }
     }
@@ -28,6 +28,7 @@ distribution.
 #include "Hooks.h"
 #include "ColorText.h"
 #include "MiscUtils.h"
+#include <chrono>
 #include <map>
 #include <string>
 #include <vector>
@@ -191,6 +192,11 @@ namespace DFHack
         {
             return state;
         }
+        // milliseconds spent opening and initializing the plugin on its last load
+        double getLoadTime() const
+        {
+            return load_time_open + load_time_init;
+        }
 
         void open_lua(lua_State *state, int table);
 
@@ -228,6 +234,18 @@ namespace DFHack
         void index_lua(DFLibrary *lib);
         void reset_lua();
 
+        // load() is split up so that PluginManager::loadAll can open
+        // libraries in parallel and then initialize them one by one
+        bool begin_load(color_ostream &out);
+        DFLibrary *open_library(color_ostream &out);
+        bool finish_load(color_ostream &out, DFLibrary *lib);
+        // undoes begin_load and open_library when finish_load will not run
+        void abort_load(DFLibrary *lib);
+        void record_load_time(std::chrono::steady_clock::duration open,
+                              std::chrono::steady_clock::duration init);
+        double load_time_open;
+        double load_time_init;
+
         bool *plugin_is_enabled;
         std::vector<std::string>* plugin_globals;
         command_result (*plugin_init)(color_ostream &, std::vector <PluginCommand> &);
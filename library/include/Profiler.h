@@ -0,0 +1,58 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#pragma once
+#include "Export.h"
+
+#include <ostream>
+
+namespace DFHack
+{
+/**
+ * Sampling profiler for the simulation thread. While running, the main
+ * thread's stack is recorded every 1/frequency seconds of its CPU time,
+ * together with the Lua function on top of the core Lua state.
+ *
+ * Start and stop requests take effect at the next Core::Update, since
+ * the timer has to be set up on the thread it samples. Only implemented
+ * on Linux; elsewhere start() returns false.
+ */
+namespace Profiler
+{
+    DFHACK_EXPORT bool isSupported();
+
+    DFHACK_EXPORT bool start(int frequency = 1000);
+    DFHACK_EXPORT void stop();
+
+    DFHACK_EXPORT bool isRunning();
+    DFHACK_EXPORT int getFrequency();
+    DFHACK_EXPORT size_t getSampleCount();
+    DFHACK_EXPORT size_t getDroppedCount();
+
+    /// Writes the samples as folded stacks, one "root;...;leaf count" line
+    /// per distinct stack, as read by flamegraph.pl and speedscope.
+    DFHACK_EXPORT bool writeFolded(std::ostream &out);
+}
+}
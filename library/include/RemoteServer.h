@@ -49,7 +49,13 @@ namespace  DFHack
         SF_DONT_SUSPEND = 2,
         // The function is considered safe to call from a remote computer.
         // All other functions cannot be allowed for security reasons.
-        SF_ALLOW_REMOTE = 4
+        SF_ALLOW_REMOTE = 4,
+        // The reply depends only on the input and on data that can only
+        // change when a world is loaded or unloaded (raws, enums, versions).
+        // It is computed once under suspend, and later calls with the same
+        // input are answered from a copy without suspending the core.
+        // Text output is only sent to the client that caused the computation.
+        SF_SNAPSHOT = 8
     };
 
     class DFHACK_EXPORT ServerFunctionBase : public RPCFunctionBase {
@@ -63,6 +69,7 @@ namespace  DFHack
 
     protected:
         friend class RPCService;
+        friend class ServerConnection;
 
         ServerFunctionBase(const message_type *in, const message_type *out,
                            RPCService *owner, const char *name, int flags)
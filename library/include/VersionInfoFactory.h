@@ -28,6 +28,7 @@ distribution.
 #include "Pragma.h"
 #include "Export.h"
 
+class TiXmlDocument;
 class TiXmlElement;
 namespace DFHack
 {
@@ -41,11 +42,16 @@ namespace DFHack
             bool isInErrorState() const {return error;};
             VersionInfo * getVersionInfoByMD5(std::string md5string);
             VersionInfo * getVersionInfoByPETimestamp(uintptr_t timestamp);
+            // Entries only carry name, OS and identifiers until they are
+            // returned by one of the lookups above or by getVersion.
             std::vector<VersionInfo*> versions;
+            VersionInfo * getVersion(size_t index);
             // trash existing list
             void clear();
         private:
-            void ParseVersion (TiXmlElement* version, VersionInfo* mem);
+            void ParseVersion (TiXmlElement* version, VersionInfo* mem, bool ids_only = false);
             bool error;
+            TiXmlDocument *doc;
+            std::vector<TiXmlElement*> pending;
     };
 }
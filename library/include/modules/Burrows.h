@@ -39,6 +39,7 @@ namespace df
     struct unit;
     struct burrow;
     struct block_burrow;
+    union tile_designation;
 }
 
 namespace DFHack
@@ -74,5 +75,14 @@ namespace Burrows
     inline bool deleteBlockMask(df::burrow *burrow, df::map_block *block) {
         return deleteBlockMask(burrow, block, getBlockMask(burrow, block));
     }
+
+    // Whole-burrow tile operations; these work a block mask at a time
+    DFHACK_EXPORT void unionTiles(df::burrow *target, df::burrow *source);
+    DFHACK_EXPORT void subtractTiles(df::burrow *target, df::burrow *source);
+    DFHACK_EXPORT void intersectTiles(df::burrow *target, df::burrow *source);
+
+    // Adds or removes every tile where (designation & mask) == value
+    DFHACK_EXPORT void setTilesByDesignation(df::burrow *target, df::tile_designation mask,
+                                             df::tile_designation value, bool enable);
 }
 }
@@ -94,6 +94,8 @@ namespace DFHack {
         DFHACK_EXPORT int32_t registerTick(EventHandler handler, int32_t when, Plugin* plugin, bool absolute=false);
         DFHACK_EXPORT void unregister(EventType::EventType e, EventHandler handler, Plugin* plugin);
         DFHACK_EXPORT void unregisterAll(Plugin* plugin);
+        // INVENTORY_CHANGE skips inactive (dead or departed) units unless this is enabled
+        DFHACK_EXPORT void setTrackInactiveInventories(bool track);
         void manageEvents(color_ostream& out);
         void onStateChange(color_ostream& out, state_change_event event);
     }
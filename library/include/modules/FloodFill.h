@@ -0,0 +1,132 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#pragma once
+#include "Export.h"
+#include "DataDefs.h"
+#include "modules/Maps.h"
+
+#include <functional>
+#include <vector>
+
+/**
+ * \defgroup grp_floodfill Scanline flood fill over map tiles
+ * @ingroup grp_modules
+ */
+
+namespace DFHack
+{
+namespace FloodFill
+{
+    enum Flags {
+        /// Also connect tiles that only touch diagonally within a z-level
+        DIAGONAL = 1,
+        /// Also connect the tiles directly above and below
+        VERTICAL = 2
+    };
+
+    /// Decides whether a tile belongs to the region being filled.
+    typedef std::function<bool(df::coord)> TileTest;
+    /// Decides whether the fill may step from a tile up (dz = 1) or down (dz = -1).
+    typedef std::function<bool(df::coord, int)> VerticalTest;
+    /// Called exactly once for every tile of the region.
+    typedef std::function<void(df::coord)> TileVisitor;
+
+    /**
+     * Scanline flood fill over map tiles.
+     *
+     * Horizontal runs of matching tiles are processed as a whole, and
+     * tiles are tracked in a visited bitmap allocated lazily per map
+     * block, so every tile is visited exactly once and only rows
+     * adjacent to a run are examined for new seeds.
+     *
+     * The tile test must not change its answer for tiles that have not
+     * been visited yet; it may change for visited ones, so the visitor
+     * is free to modify the tile it is called for.
+     *
+     * The visited bitmap persists across calls to fill(), so several
+     * seeds can be used to grow one region. Use reset() to start over.
+     * \ingroup grp_floodfill
+     */
+    class DFHACK_EXPORT Engine
+    {
+    public:
+        Engine(const TileTest &test, unsigned flags = 0);
+
+        /// Restricts the fill to an inclusive box. Defaults to the whole map.
+        void setBounds(df::coord min, df::coord max);
+        /// Restricts vertical steps, e.g. to those allowed by the source tile shape.
+        void setVerticalTest(const VerticalTest &vtest) { this->vtest = vtest; }
+
+        bool inBounds(df::coord pos) const {
+            return pos.x >= bmin.x && pos.x <= bmax.x &&
+                   pos.y >= bmin.y && pos.y <= bmax.y &&
+                   pos.z >= bmin.z && pos.z <= bmax.z;
+        }
+        bool isVisited(df::coord pos) const;
+
+        /// Fills the region connected to start; returns the number of tiles visited.
+        size_t fill(df::coord start, const TileVisitor &visit);
+
+        /// Forgets all visited tiles.
+        void reset();
+
+    private:
+        struct Span {
+            int16_t x1, x2, y, z;
+        };
+
+        TileTest test;
+        VerticalTest vtest;
+        unsigned flags;
+        df::coord bmin, bmax;
+
+        int xblocks, yblocks, zblocks;
+        // index of the 16 row masks of each block in 'rows', or -1
+        std::vector<int32_t> block_slot;
+        std::vector<uint16_t> rows;
+
+        std::vector<Span> seeds;
+
+        int blockIndex(int x, int y, int z) const {
+            return ((z * yblocks) + (y >> 4)) * xblocks + (x >> 4);
+        }
+        uint16_t *rowMask(int x, int y, int z, bool create);
+        bool visited(int x, int y, int z) const;
+        bool accept(int x, int y, int z) {
+            return !visited(x, y, z) && test(df::coord(x, y, z));
+        }
+        void markSpan(int x1, int x2, int y, int z);
+        void scanRow(int x1, int x2, int y, int z, int from_z);
+    };
+
+    /// Convenience wrapper for a one-shot fill over the whole map.
+    inline size_t fill(df::coord start, const TileTest &test, const TileVisitor &visit, unsigned flags = 0)
+    {
+        Engine engine(test, flags);
+        return engine.fill(start, visit);
+    }
+}
+}
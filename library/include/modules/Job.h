@@ -93,6 +93,8 @@ namespace DFHack
         DFHACK_EXPORT bool removePostings(df::job *job, bool remove_all = false);
 
         // lists jobs with ids >= *id_var, and sets *id_var = *job_next_id;
+        // during Core::Update the list is walked at most once and shared
+        // between callers, so prefer this to scanning world->jobs.list
         DFHACK_EXPORT bool listNewlyCreated(std::vector<df::job*> *pvec, int *id_var);
 
         DFHACK_EXPORT bool attachJobItem(df::job *job, df::item *item,
@@ -43,6 +43,8 @@ distribution.
 #include "df/tile_liquid.h"
 #include "df/tile_traffic.h"
 #include "df/tiletype.h"
+#include "df/tiletype_material.h"
+#include "df/tiletype_shape.h"
 
 namespace df {
     struct block_square_event;
@@ -65,6 +67,11 @@ namespace df {
     union tile_occupancy;
 }
 
+namespace MapExtras
+{
+    class MapCache;
+}
+
 /**
  * \defgroup grp_maps Maps module and its types
  * @ingroup grp_modules
@@ -333,6 +340,38 @@ extern DFHACK_EXPORT bool RemoveBlockEvent(uint32_t x, uint32_t y, uint32_t z, d
 
 DFHACK_EXPORT bool canWalkBetween(df::coord pos1, df::coord pos2);
 DFHACK_EXPORT bool canStepBetween(df::coord pos1, df::coord pos2);
+
+/**
+ * Caller-owned arrays for readRegion, one per tile property. Arrays left
+ * NULL are skipped; every other one needs an entry for each tile of the
+ * region, at ((z - min.z) * dim_y + (y - min.y)) * dim_x + (x - min.x).
+ */
+struct TileRegionBuffers
+{
+    df::tiletype *tiletype;
+    df::tiletype_shape *shape;
+    df::tiletype_material *tile_material;
+    int16_t *mat_type;              // static material: layer, vein, feature or construction
+    int32_t *mat_index;
+    uint8_t *liquid_level;          // designation flow_size
+    df::tile_liquid *liquid_type;
+    uint32_t *designation;          // tile_designation::whole
+    uint32_t *occupancy;            // tile_occupancy::whole
+
+    TileRegionBuffers()
+        : tiletype(NULL), shape(NULL), tile_material(NULL), mat_type(NULL), mat_index(NULL),
+          liquid_level(NULL), liquid_type(NULL), designation(NULL), occupancy(NULL)
+    {}
+};
+
+/**
+ * Copies the tiles in the box from min to max (inclusive) into the
+ * buffers, one map block at a time. Tiles outside the map or in
+ * unallocated blocks read as Void with zero flags and material -1.
+ * Materials need a MapCache; one is created for the call if not given.
+ */
+DFHACK_EXPORT bool readRegion(df::coord min, df::coord max, const TileRegionBuffers &out,
+                              MapExtras::MapCache *cache = NULL);
 }
 }
 #endif
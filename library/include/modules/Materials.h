@@ -41,6 +41,7 @@ distribution.
 
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 namespace df
 {
@@ -172,6 +173,76 @@ namespace DFHack
     DFHACK_EXPORT bool isSoilInorganic(int material);
     DFHACK_EXPORT bool isStoneInorganic(int material);
 
+    /**
+     * Marks every RawTokenIndex stale, so that each one is rebuilt on its
+     * next lookup. Call after renaming raws in place; world load and unload
+     * are already handled by the library.
+     * \ingroup grp_materials
+     */
+    DFHACK_EXPORT void invalidateRawTokenIndexes();
+    DFHACK_EXPORT unsigned getRawTokenGeneration();
+
+    /**
+     * Hash index from raw id strings to positions in a raw vector.
+     * Built lazily on the first lookup, and rebuilt whenever the vector
+     * storage changes, a hit no longer matches, or the indexes have been
+     * invalidated. The library keeps one per raw vector for
+     * MaterialInfo::find* and ItemTypeInfo::find, and clears them on world
+     * load and unload.
+     * \ingroup grp_materials
+     */
+    class RawTokenIndex
+    {
+        std::unordered_map<std::string, int32_t> ids;
+        const void *base = NULL;
+        size_t count = 0;
+        unsigned generation = 0;
+        bool valid = false;
+
+        template<class T, class F>
+        void rebuild(T *const *items, size_t size, F get_id)
+        {
+            ids.clear();
+            ids.reserve(size);
+            for (size_t i = 0; i < size; i++)
+                if (items[i])
+                    ids.emplace(get_id(items[i]), int32_t(i)); // first one wins, like a scan
+            base = items;
+            count = size;
+            generation = getRawTokenGeneration();
+            valid = true;
+        }
+
+    public:
+        void clear() { ids.clear(); base = NULL; count = 0; valid = false; }
+
+        template<class T, class F>
+        int32_t find(T *const *items, size_t size, const std::string &token, F get_id)
+        {
+            if (!valid || items != base || size != count || generation != getRawTokenGeneration())
+                rebuild(items, size, get_id);
+
+            // Misses are common (MaterialInfo::find tries several kinds in
+            // turn), so they are trusted; renames are caught by invalidation
+            auto it = ids.find(token);
+            if (it == ids.end())
+                return -1;
+            if (items[it->second] && get_id(items[it->second]) == token)
+                return it->second;
+
+            // Raws were edited in place; start over
+            rebuild(items, size, get_id);
+            it = ids.find(token);
+            return it != ids.end() ? it->second : -1;
+        }
+
+        template<class T, class F>
+        int32_t find(const std::vector<T*> &vec, const std::string &token, F get_id)
+        {
+            return find(vec.data(), vec.size(), token, get_id);
+        }
+    };
+
     typedef int32_t t_materialIndex;
     typedef int16_t t_materialType, t_itemType, t_itemSubtype;
 
@@ -136,6 +136,9 @@ namespace DFHack
             void set_tile(unsigned int x, unsigned int y, Screen::Pen pen);
             void draw(unsigned int x, unsigned int y, unsigned int width, unsigned int height,
                 unsigned int bufx = 0, unsigned int bufy = 0);
+            // inverse of draw: copies screen tiles into the buffer
+            void read(unsigned int x, unsigned int y, unsigned int width, unsigned int height,
+                unsigned int bufx = 0, unsigned int bufy = 0);
         };
 
         struct DFHACK_EXPORT ViewRect {
@@ -196,6 +199,45 @@ namespace DFHack
         /// Retrieves one screen tile from the buffer
         DFHACK_EXPORT Pen readTile(int x, int y, bool map = false);
 
+        /**
+         * Copy of a screen rectangle, one array per Pen field. Tiles are
+         * stored column by column like gps->screen; use index() to locate
+         * one. Reusing the same object for the same area keeps track of
+         * which tiles changed since the previous snapshot.
+         */
+        struct DFHACK_EXPORT TileSnapshot {
+            rect2d area;
+            int width, height;
+
+            std::vector<uint8_t> ch, fg, bg, bold;
+            std::vector<int32_t> tile;
+            std::vector<uint8_t> tile_mode;
+            std::vector<int8_t> tile_fg, tile_bg;
+
+            // one bit per tile, set if it differs from the previous snapshot
+            std::vector<uint64_t> changed;
+            size_t num_changed;
+
+            TileSnapshot() : width(0), height(0), num_changed(0) {}
+
+            size_t size() const { return size_t(width) * height; }
+            bool inside(int x, int y) const {
+                return x >= area.first.x && x <= area.second.x &&
+                       y >= area.first.y && y <= area.second.y;
+            }
+            size_t index(int x, int y) const {
+                return size_t(x - area.first.x) * height + (y - area.first.y);
+            }
+            bool isChanged(size_t idx) const {
+                return (changed[idx >> 6] >> (idx & 63)) & 1;
+            }
+            Pen get(size_t idx) const;
+        };
+
+        /// Reads a screen rectangle into snap, clipped to the window.
+        /// Returns false if nothing of it is visible.
+        DFHACK_EXPORT bool readRect(TileSnapshot *snap, int x1, int y1, int x2, int y2, bool map = false);
+
         /// Paint a string onto the screen. Ignores ch and tile of pen.
         DFHACK_EXPORT bool paintString(const Pen &pen, int x, int y, const std::string &text, bool map = false);
 
@@ -181,6 +181,40 @@ namespace DFHack
 
         DFHACK_EXPORT void ClearPersistentCache();
 
+        // Compact key/value store, also saved with the world, for plugins with
+        // many records. Records are packed into a few binary chunks instead of
+        // one historical figure each; the store is decoded on first use after
+        // a load, and modified chunks are written back once per frame.
+        enum PersistentValueType : uint8_t {
+            PERSIST_BLOB = 0,
+            PERSIST_STRING,
+            PERSIST_INT,    // int64_t, little-endian
+            PERSIST_NUMBER, // double
+            // An item of the API above: NumInts little-endian int32_t
+            // values, followed by the string value.
+            PERSIST_LEGACY
+        };
+        // Fails if the encoded record would not fit into one page of a chunk
+        // (about 30000 bytes). Writing a key that also exists as a
+        // PersistentDataItem deletes the (first) item; this migration is
+        // one-way, older builds will no longer see the value.
+        DFHACK_EXPORT bool SetPersistentValue(const std::string &key, const std::string &data,
+                                              uint8_t type = PERSIST_BLOB);
+        // If key is not in the store but a PersistentDataItem with that key
+        // exists, the (first) item is returned as PERSIST_LEGACY and left
+        // in place until the key is written or deleted.
+        DFHACK_EXPORT bool GetPersistentValue(const std::string &key, std::string *data,
+                                              uint8_t *type = NULL);
+        DFHACK_EXPORT bool SetPersistentInt(const std::string &key, int64_t value);
+        DFHACK_EXPORT bool GetPersistentInt(const std::string &key, int64_t *value);
+        // Also deletes a PersistentDataItem with that key.
+        DFHACK_EXPORT bool DeletePersistentValue(const std::string &key);
+        // Lists the keys starting with prefix, in alphabetic order.
+        DFHACK_EXPORT void ListPersistentValues(std::vector<std::string> *keys,
+                                                const std::string &prefix = std::string());
+        // Writes modified chunks back into the world. Called by Core after each frame.
+        DFHACK_EXPORT void FlushPersistentStore();
+
         DFHACK_EXPORT df::tile_bitmask *getPersistentTilemask(const PersistentDataItem &item, df::map_block *block, bool create = false);
         DFHACK_EXPORT bool deletePersistentTilemask(const PersistentDataItem &item, df::map_block *block);
     }
@@ -10,9 +10,10 @@ It is a wrapper over dfhack.persistent calls.
 It supports tables of arbitrary dimension and shape.
 It stores information about each table and subtable's size and children.
 
-For convenience, all stored information is itself persistent.
-It would be more efficient to cache stored information in global variables and update it on save/load but this is not yet implemented.
-Ask expwnent to try this if performance is bad.
+Entries are kept in the compact store behind dfhack.persistent.getValue and
+setValue, which lives in memory and is written back to the world in batches.
+Entries saved by older versions, one persistent record per key, are converted
+the first time they are read.
 
 Usage:
 local persistTable = require 'persist-table'
@@ -43,9 +44,9 @@ And so on.
 
 Be careful not to name your tables in a way that will conflict with other scripts! The easiest way is to just put all your tables in one giant table named based on your script.
 
-All stored values MUST be strings. Numbers can be supported later but are not yet supported. Keep in mind there is a significant overhead for each table element so don't go totally crazy storing massive amounts of information or the game will run out of RAM.
+All stored values MUST be strings. Numbers can be supported later but are not yet supported.
 
---table._children returns a list of child keys
+--table._children returns a list of child keys, in alphabetical order
 for _,childKey in ipairs(table._children) do
  local child = table[childKey]
  --blah
@@ -54,173 +55,135 @@ end
 --]]
 
 local prefix = 'persist-table'
+local persistent = dfhack.persistent
 
-local function ensure(name)
- return dfhack.persistent.save({key=name})
+local function entryKey(id, key)
+ return prefix .. id .. '$$' .. key
 end
 
-local function gensym()
- local availables = dfhack.persistent.get_all(prefix .. '$available') or {}
- local available = nil
- local smallest = nil
- for _,candidate in pairs(availables) do
-  --TODO: it would be great if we could iterate over these in order but we can't
-  local score = tonumber(candidate.value)
-  --print('gensym', candidate, score, available, smallest)
-  if (score and (not available or score < smallest)) then
-   smallest = score
-   available = candidate
+--layout of the entries written by older versions
+local intCount = 7
+local existIndex = intCount-0
+local existValue = 1
+local pointerIndex = intCount-1
+local pointerValue = 1
+
+--returns the stored string, or the id of the subtable and true
+local function read(id, key)
+ local name = entryKey(id, key)
+ local value, valueType = persistent.getValue(name)
+ if valueType == 'legacy' then
+  local ints = {string.unpack('<' .. string.rep('i4', intCount), value)}
+  value = value:sub(4*intCount+1)
+  if ints[existIndex] ~= existValue then
+   persistent.setValue(name, nil)
+   return nil
   end
+  valueType = ints[pointerIndex] == pointerValue and 'blob' or 'string'
+  persistent.setValue(name, value, valueType)
+ end
+ if valueType == 'string' then
+  return value, false
+ elseif valueType == 'blob' then
+  return value, true
  end
- if available then
-  local value = available.value
-  available:delete()
-  --print('gensym: allocate ' .. value)
-  return value
+ return nil
+end
+
+local function children(id)
+ --fold in the child list of an old table first
+ for _,item in ipairs(persistent.get_all(prefix .. id) or {}) do
+  read(id, item.value)
+  item:delete()
  end
- --none explicitly available, so smallest unused is the next available number
- local smallestUnused = ensure(prefix .. '$smallest_unused')
- if smallestUnused.value == '' then
-  smallestUnused.value = '0'
+ local base = entryKey(id, '')
+ local result = {}
+ for _,name in ipairs(persistent.listValues(base)) do
+  table.insert(result, name:sub(#base+1))
  end
- local result = smallestUnused.value
- smallestUnused.value = tostring(1+tonumber(result))
- smallestUnused:save()
-  --print('gensym: allocate ' .. result)
  return result
 end
 
-local function releasesym(symb)
- local availables = dfhack.persistent.get_all(prefix .. '$available') or {}
- for _,available in pairs(availables) do
-  --print('releasesym: ', symb, available.value, available)
-  if available.value == symb then
-   print('error: persist-table.releasesym(' .. symb .. '): available.value = ' .. available.value)
-   return
+local nextIdKey = prefix .. '$next_id'
+
+local function gensym()
+ local result = persistent.getValue(nextIdKey)
+ if not result then
+  --continue after the ids handed out by older versions
+  local smallestUnused = persistent.get(prefix .. '$smallest_unused')
+  result = smallestUnused and math.tointeger(tonumber(smallestUnused.value)) or 0
+  for _,item in ipairs(persistent.get_all(prefix .. '$available') or {}) do
+   item:delete()
+  end
+  if smallestUnused then
+   smallestUnused:delete()
   end
  end
- dfhack.persistent.save({key=prefix .. '$available', value=symb}, true)
- --print('releasesym: unallocate ' .. symb)
-end
-local intCount = 7
-local existIndex = intCount-0
-local existValue = 1
-local pointerIndex = intCount-1
-local pointerValue = 1
-local defaultValue = -1
-
-local function isEmpty(table)
- return next(table) == nil
+ persistent.setValue(nextIdKey, result+1)
+ return tostring(result)
 end
 
-local function deletePersistent(name)
-  if name == '' then
-   return
-  end
-  local children = dfhack.persistent.get_all(prefix .. name) or {}
-  for _,childKey in ipairs(children) do
-   local childEntry = ensure(prefix .. name .. '$$' .. childKey.value)
-   if childEntry.ints[existIndex] == existValue and childEntry.ints[pointerIndex] == pointerValue then
-    deletePersistent(childEntry.value)
-   end
-   childEntry:delete()
-   childKey:delete()
+local function deletePersistent(id)
+ for _,key in ipairs(children(id)) do
+  local value, isTable = read(id, key)
+  if isTable then
+   deletePersistent(value)
   end
-  releasesym(name)
+  persistent.setValue(entryKey(id, key), nil)
+ end
 end
 
 GlobalTable = GlobalTable or {key = 'mastertable'}
 GlobalTable.mt = GlobalTable.mt or {}
-GlobalTable.mt.__index = GlobalTable.mt.__index or function(theTable, key)
- if key == '_children' then
-  return rawget(theTable,key)
+
+local subtables = setmetatable({}, {__mode = 'v'})
+
+local function subtable(id)
+ local result = subtables[id]
+ if not result then
+  result = {key = id, mt = rawget(GlobalTable,'mt')}
+  setmetatable(result,rawget(GlobalTable,'mt'))
+  subtables[id] = result
  end
- --print(rawget(theTable,'key') .. '[' .. key .. ']')
- local entry = ensure(prefix .. rawget(theTable,'key') .. '$$' .. key)
- if entry.ints[existIndex] == existValue and entry.ints[pointerIndex] == defaultValue then
-  --print('string: ' .. entry.value)
-  return entry.value
+ return result
+end
+
+GlobalTable.mt.__index = function(theTable, key)
+ local id = rawget(theTable,'key')
+ if key == '_children' then
+  return children(id)
  end
- if entry.ints[pointerIndex] == pointerValue then
-  --pre-existing pointer
-  local result = {key = entry.value}
-  result.mt = rawget(GlobalTable,'mt')
-  local childArgs = dfhack.persistent.get_all(prefix .. entry.value)
-  result._children = {}
-  for _,childArg in ipairs(childArgs or {}) do
-   --print(result._children, childArg.value)
-   table.insert(result._children, childArg.value)
-  end
-  setmetatable(result,rawget(GlobalTable,'mt'))
-  --print('theTable: ' .. entry.value)
-  return result
+ local value, isTable = read(id, key)
+ if isTable then
+  return subtable(value)
  end
- entry:delete()
- --print 'theTable[key] does not exist.'
- return nil
+ return value
 end
-GlobalTable.mt.__newindex = GlobalTable.mt.__newindex or function(theTable, key, value)
- --print(rawget(theTable,'key') .. '[' .. key .. '] = ' .. tostring(value))
- local entry = ensure(prefix .. rawget(theTable,'key') .. '$$' .. key)
- local old = entry.value
- local isNew = entry.ints[existIndex] == defaultValue
- if entry.ints[existIndex] == existValue and entry.ints[pointerIndex] == pointerValue then
-  if type(value) == 'table' and rawget(value,'mt') == rawget(GlobalTable,'mt') and entry.value == rawget(value,'key') then
+GlobalTable.mt.__newindex = function(theTable, key, value)
+ local id = rawget(theTable,'key')
+ local old, oldIsTable = read(id, key)
+ if oldIsTable then
+  if type(value) == 'table' and rawget(value,'mt') == rawget(GlobalTable,'mt') and old == rawget(value,'key') then
    --if setting it to the same table it already is, then don't do anything
    return
   end
-  deletePersistent(entry.value)
+  deletePersistent(old)
  end
+ local name = entryKey(id, key)
  if not value then
-  --print('__newindesx: delete')
-  --delete
-  for i,child in ipairs(dfhack.persistent.get_all(prefix .. rawget(theTable,'key')) or {}) do
-   if child.value == key then
-    child:delete()
-   end
-  end
-  entry:delete()
-  return
+  persistent.setValue(name, nil)
  elseif type(value) == 'string' then
-  --print('__newindesx: string')
-  entry.value = value
-  entry.ints[pointerIndex] = defaultValue
-  entry.ints[existIndex] = existValue
-  entry:save()
-  if isNew then
-   --print('new child!')
-   dfhack.persistent.save({key=prefix .. rawget(theTable,'key'), value=key}, true)
-  end
-  return
+  persistent.setValue(name, value, 'string')
  elseif type(value) == 'table' then
-  --print('__newindesx: table')
   if rawget(value,'mt') ~= rawget(GlobalTable,'mt') then
-   if not isEmpty(value) then
+   if next(value) ~= nil then
     error('setting value to an invalid table')
    end
-   --print('__newindesx: empty table')
    --empty table: allocate a thing
-   entry.ints[pointerIndex] = pointerValue
-   entry.ints[existIndex] = existValue
-   entry.value = gensym()
-   entry:save()
-
-   if isNew then
-    --print('new child!')
-    dfhack.persistent.save({key=prefix .. rawget(theTable,'key'), value=key}, true)
-   end
-   return
-  end
-  --print('__newindesx: table assignment')
-  entry.value = rawget(value,'key')
-  entry.ints[pointerIndex] = pointerValue
-  entry.ints[existIndex] = existValue
-  entry:save()
-  if isNew then
-   --print('new child!')
-   dfhack.persistent.save({key=prefix .. rawget(theTable,'key'), value=key}, true)
+   persistent.setValue(name, gensym(), 'blob')
+  else
+   persistent.setValue(name, rawget(value,'key'), 'blob')
   end
-  return
  else
   error('type(value) = ' .. type(value))
  end
@@ -18,7 +18,7 @@ function cancel(name)
   return false
  end
  if repeating[name] ~= -1 then
-  dfhack.timeout_active(repeating[name],nil)
+  dfhack.timeout_cancel(repeating[name])
  end
  repeating[name] = nil
  return true
@@ -27,6 +27,7 @@ distribution.
 
 #include <vector>
 #include <cstdlib>
+#include <unordered_map>
 using namespace std;
 
 #include "Core.h"
@@ -42,6 +43,7 @@ using namespace std;
 #include "df/block_burrow_link.h"
 #include "df/burrow.h"
 #include "df/map_block.h"
+#include "df/tile_designation.h"
 #include "df/ui.h"
 #include "df/world.h"
 
@@ -156,6 +158,35 @@ static void destroyBurrowMask(df::block_burrow *mask)
     delete mask;
 }
 
+static df::block_burrow *linkBurrowMask(df::burrow *burrow, df::block_burrow_link *prev)
+{
+    auto link = new df::block_burrow_link;
+    link->item = new df::block_burrow;
+
+    link->item->id = burrow->id;
+    link->item->tile_bitmask.clear();
+    link->item->link = link;
+
+    link->next = NULL;
+    link->prev = prev;
+    prev->next = link;
+
+    return link->item;
+}
+
+static df::block_burrow *findBurrowMask(int32_t id, df::map_block *block, df::block_burrow_link **last = NULL)
+{
+    df::block_burrow_link *prev = &block->block_burrows;
+
+    for (auto link = prev->next; link; prev = link, link = link->next)
+        if (link->item->id == id)
+            return link->item;
+
+    if (last)
+        *last = prev;
+    return NULL;
+}
+
 void Burrows::clearTiles(df::burrow *burrow)
 {
     CHECK_NULL_POINTER(burrow);
@@ -183,26 +214,13 @@ df::block_burrow *Burrows::getBlockMask(df::burrow *burrow, df::map_block *block
     CHECK_NULL_POINTER(burrow);
     CHECK_NULL_POINTER(block);
 
-    int32_t id = burrow->id;
-    df::block_burrow_link *prev = &block->block_burrows;
-    df::block_burrow_link *link = prev->next;
-
-    for (; link; prev = link, link = link->next)
-        if (link->item->id == id)
-            return link->item;
+    df::block_burrow_link *prev;
+    if (auto mask = findBurrowMask(burrow->id, block, &prev))
+        return mask;
 
     if (create)
     {
-        link = new df::block_burrow_link;
-        link->item = new df::block_burrow;
-
-        link->item->id = burrow->id;
-        link->item->tile_bitmask.clear();
-        link->item->link = link;
-
-        link->next = NULL;
-        link->prev = prev;
-        prev->next = link;
+        auto mask = linkBurrowMask(burrow, prev);
 
         df::coord base(world->map.region_x*3,world->map.region_y*3,world->map.region_z);
         df::coord pos = base + block->map_pos/16;
@@ -211,7 +229,7 @@ df::block_burrow *Burrows::getBlockMask(df::burrow *burrow, df::map_block *block
         burrow->block_y.push_back(pos.y);
         burrow->block_z.push_back(pos.z);
 
-        return link->item;
+        return mask;
     }
 
     return NULL;
@@ -277,3 +295,253 @@ bool Burrows::setAssignedBlockTile(df::burrow *burrow, df::map_block *block, df:
     return true;
 }
 
+
+namespace {
+    /*
+     * Maps the blocks of one burrow to their masks for the duration of a
+     * bulk operation, so that each lookup is a hash probe instead of a
+     * walk through block_burrows, and deleting masks does not rescan the
+     * coordinate vectors each time. DF does not run during the operation,
+     * so nothing in it can go stale.
+     */
+    class BlockIndex {
+        df::burrow *burrow;
+        df::coord base;
+        std::unordered_map<df::map_block*, size_t> slots;
+        std::vector<df::map_block*> blocks;  // parallel to burrow->block_x
+        std::vector<df::block_burrow*> masks;
+        bool removed_any;
+
+    public:
+        BlockIndex(df::burrow *burrow)
+            : burrow(burrow), removed_any(false)
+        {
+            base = df::coord(world->map.region_x*3,world->map.region_y*3,world->map.region_z);
+
+            size_t count = burrow->block_x.size();
+            blocks.reserve(count);
+            masks.reserve(count);
+            slots.reserve(count);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                df::coord pos(burrow->block_x[i], burrow->block_y[i], burrow->block_z[i]);
+
+                auto block = Maps::getBlock(pos - base);
+                blocks.push_back(block);
+                masks.push_back(block ? findBurrowMask(burrow->id, block) : NULL);
+                if (block)
+                    slots[block] = i;
+            }
+        }
+
+        ~BlockIndex() { compact(); }
+
+        size_t size() { return blocks.size(); }
+        df::map_block *block(size_t i) { return blocks[i]; }
+        df::block_burrow *mask(size_t i) { return masks[i]; }
+
+        df::block_burrow *get(df::map_block *block, bool create)
+        {
+            auto it = slots.find(block);
+            if (it != slots.end() && masks[it->second])
+                return masks[it->second];
+            if (!create)
+                return NULL;
+
+            df::block_burrow_link *prev;
+            auto mask = findBurrowMask(burrow->id, block, &prev);
+            if (!mask)
+                mask = linkBurrowMask(burrow, prev);
+
+            if (it != slots.end())
+            {
+                // coordinates are still in block_x, pending compaction
+                masks[it->second] = mask;
+                return mask;
+            }
+
+            df::coord pos = base + block->map_pos/16;
+            burrow->block_x.push_back(pos.x);
+            burrow->block_y.push_back(pos.y);
+            burrow->block_z.push_back(pos.z);
+
+            slots[block] = blocks.size();
+            blocks.push_back(block);
+            masks.push_back(mask);
+            return mask;
+        }
+
+        void remove(size_t i)
+        {
+            destroyBurrowMask(masks[i]);
+            masks[i] = NULL;
+            removed_any = true;
+        }
+
+        void removeIfEmpty(size_t i)
+        {
+            if (masks[i] && !masks[i]->has_assignments())
+                remove(i);
+        }
+
+        void removeIfEmpty(df::map_block *block)
+        {
+            auto it = slots.find(block);
+            if (it != slots.end())
+                removeIfEmpty(it->second);
+        }
+
+        // Drops the coordinates of deleted masks in one pass. Entries for
+        // blocks that are not loaded are kept, like deleteBlockMask does.
+        void compact()
+        {
+            if (!removed_any)
+                return;
+
+            size_t out = 0;
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                if (blocks[i] && !masks[i])
+                    continue;
+
+                burrow->block_x[out] = burrow->block_x[i];
+                burrow->block_y[out] = burrow->block_y[i];
+                burrow->block_z[out] = burrow->block_z[i];
+                blocks[out] = blocks[i];
+                masks[out] = masks[i];
+                out++;
+            }
+
+            burrow->block_x.resize(out);
+            burrow->block_y.resize(out);
+            burrow->block_z.resize(out);
+            blocks.resize(out);
+            masks.resize(out);
+
+            slots.clear();
+            for (size_t i = 0; i < out; i++)
+                if (blocks[i])
+                    slots[blocks[i]] = i;
+
+            removed_any = false;
+        }
+    };
+}
+
+void Burrows::unionTiles(df::burrow *target, df::burrow *source)
+{
+    CHECK_NULL_POINTER(target);
+    CHECK_NULL_POINTER(source);
+
+    if (source == target)
+        return;
+
+    BlockIndex tindex(target), sindex(source);
+
+    for (size_t i = 0; i < sindex.size(); i++)
+    {
+        auto smask = sindex.mask(i);
+        if (!smask || !smask->has_assignments())
+            continue;
+
+        tindex.get(sindex.block(i), true)->tile_bitmask |= smask->tile_bitmask;
+    }
+}
+
+void Burrows::subtractTiles(df::burrow *target, df::burrow *source)
+{
+    CHECK_NULL_POINTER(target);
+    CHECK_NULL_POINTER(source);
+
+    if (source == target)
+    {
+        clearTiles(target);
+        return;
+    }
+
+    BlockIndex tindex(target), sindex(source);
+
+    for (size_t i = 0; i < sindex.size(); i++)
+    {
+        auto smask = sindex.mask(i);
+        if (!smask)
+            continue;
+
+        auto block = sindex.block(i);
+        auto tmask = tindex.get(block, false);
+        if (!tmask)
+            continue;
+
+        tmask->tile_bitmask -= smask->tile_bitmask;
+        tindex.removeIfEmpty(block);
+    }
+}
+
+void Burrows::intersectTiles(df::burrow *target, df::burrow *source)
+{
+    CHECK_NULL_POINTER(target);
+    CHECK_NULL_POINTER(source);
+
+    if (source == target)
+        return;
+
+    BlockIndex tindex(target), sindex(source);
+
+    for (size_t i = 0; i < tindex.size(); i++)
+    {
+        auto tmask = tindex.mask(i);
+        if (!tmask)
+            continue;
+
+        auto smask = sindex.get(tindex.block(i), false);
+        if (smask)
+        {
+            tmask->tile_bitmask &= smask->tile_bitmask;
+            tindex.removeIfEmpty(i);
+        }
+        else
+            tindex.remove(i);
+    }
+}
+
+void Burrows::setTilesByDesignation(df::burrow *target, df::tile_designation d_mask,
+                                    df::tile_designation d_value, bool enable)
+{
+    CHECK_NULL_POINTER(target);
+
+    BlockIndex tindex(target);
+    auto &blocks = world->map.map_blocks;
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        auto block = blocks[i];
+
+        if (!enable && !tindex.get(block, false))
+            continue;
+
+        // Evaluate the whole block first, then apply it as one mask
+        df::tile_bitmask match;
+        match.clear();
+
+        for (int x = 0; x < 16; x++)
+        {
+            for (int y = 0; y < 16; y++)
+            {
+                if ((block->designation[x][y].whole & d_mask.whole) == d_value.whole)
+                    match[y] |= uint16_t(1 << x);
+            }
+        }
+
+        if (!match.has_assignments())
+            continue;
+
+        if (enable)
+            tindex.get(block, true)->tile_bitmask |= match;
+        else
+        {
+            tindex.get(block, false)->tile_bitmask -= match;
+            tindex.removeIfEmpty(block);
+        }
+    }
+}
@@ -182,8 +182,15 @@ static int32_t lastSyndromeTime;
 static int32_t nextInvasion;
 
 //equipment change
-//static unordered_map<int32_t, vector<df::unit_inventory_item> > equipmentLog;
-static unordered_map<int32_t, vector<InventoryItem> > equipmentLog;
+//one slot per unit id; a unit's items are only compared when its fingerprint moves
+struct UnitInventoryLog {
+    bool known;
+    uint64_t fingerprint;
+    vector<InventoryItem> items;
+    UnitInventoryLog(): known(false), fingerprint(0) {}
+};
+static vector<UnitInventoryLog> equipmentLog;
+static bool trackInactiveInventories = false;
 
 //report
 static int32_t lastReport;
@@ -196,6 +203,10 @@ static int32_t reportToRelevantUnitsTime = -1;
 //interaction
 static int32_t lastReportInteraction;
 
+void DFHack::EventManager::setTrackInactiveInventories(bool track) {
+    trackInactiveInventories = track;
+}
+
 void DFHack::EventManager::onStateChange(color_ostream& out, state_change_event event) {
     static bool doOnce = false;
 //    const string eventNames[] = {"world loaded", "world unloaded", "map loaded", "map unloaded", "viewscreen changed", "core initialized", "begin unload", "paused", "unpaused"};
@@ -381,17 +392,16 @@ static void manageJobInitiatedEvent(color_ostream& out) {
     }
     multimap<Plugin*,EventHandler> copy(handlers[EventType::JOB_INITIATED].begin(), handlers[EventType::JOB_INITIATED].end());
 
-    for ( df::job_list_link* link = &df::global::world->jobs.list; link != NULL; link = link->next ) {
-        if ( link->item == NULL )
-            continue;
-        if ( link->item->id <= lastJobId )
-            continue;
+    int nextId = lastJobId+1;
+    vector<df::job*> newJobs;
+    Job::listNewlyCreated(&newJobs, &nextId);
+    for ( size_t a = 0; a < newJobs.size(); a++ ) {
         for ( auto i = copy.begin(); i != copy.end(); i++ ) {
-            (*i).second.eventHandler(out, (void*)link->item);
+            (*i).second.eventHandler(out, (void*)newJobs[a]);
         }
     }
 
-    lastJobId = *df::global::job_next_id - 1;
+    lastJobId = nextId - 1;
 }
 
 //helper function for manageJobCompletedEvent
@@ -712,41 +722,55 @@ static void manageInvasionEvent(color_ostream& out) {
     }
 }
 
+static uint64_t inventoryFingerprint(df::unit* unit) {
+    // FNV-1a over the fields a change event is reported for
+    uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h](uint32_t v) {
+        for ( int i = 0; i < 4; i++, v >>= 8 ) {
+            h ^= v & 0xff;
+            h *= 1099511628211ULL;
+        }
+    };
+    mix(unit->inventory.size());
+    for ( size_t b = 0; b < unit->inventory.size(); b++ ) {
+        df::unit_inventory_item* dfitem = unit->inventory[b];
+        mix(dfitem->item->id);
+        mix(dfitem->mode);
+        mix(dfitem->body_part_id);
+        mix(dfitem->wound_id);
+    }
+    return h;
+}
+
 static void manageEquipmentEvent(color_ostream& out) {
     if (!df::global::world)
         return;
     multimap<Plugin*,EventHandler> copy(handlers[EventType::INVENTORY_CHANGE].begin(), handlers[EventType::INVENTORY_CHANGE].end());
 
-    unordered_map<int32_t, InventoryItem> itemIdToInventoryItem;
-    unordered_set<int32_t> currentlyEquipped;
     for ( auto a = df::global::world->units.all.begin(); a != df::global::world->units.all.end(); a++ ) {
-        itemIdToInventoryItem.clear();
-        currentlyEquipped.clear();
         df::unit* unit = *a;
-        /*if ( unit->flags1.bits.inactive )
+        if ( unit->id < 0 )
+            continue;
+        if ( unit->flags1.bits.inactive && !trackInactiveInventories )
             continue;
-        */
 
-        auto oldEquipment = equipmentLog.find(unit->id);
-        bool hadEquipment = oldEquipment != equipmentLog.end();
-        vector<InventoryItem>* temp;
-        if ( hadEquipment ) {
-            temp = &((*oldEquipment).second);
-        } else {
-            temp = new vector<InventoryItem>;
-        }
-        //vector<InventoryItem>& v = (*oldEquipment).second;
-        vector<InventoryItem>& v = *temp;
-        for ( auto b = v.begin(); b != v.end(); b++ ) {
-            InventoryItem& i = *b;
-            itemIdToInventoryItem[i.itemId] = i;
-        }
+        if ( size_t(unit->id) >= equipmentLog.size() )
+            equipmentLog.resize(unit->id + 1 + unit->id / 4);
+        UnitInventoryLog& log = equipmentLog[unit->id];
+        uint64_t fingerprint = inventoryFingerprint(unit);
+        if ( log.known && log.fingerprint == fingerprint )
+            continue;
+
+        // Inventories are short, so the diff below just scans them.
+        // A unit seen for the first time reports everything it carries.
+        vector<InventoryItem>& v = log.items;
         for ( size_t b = 0; b < unit->inventory.size(); b++ ) {
             df::unit_inventory_item* dfitem_new = unit->inventory[b];
-            currentlyEquipped.insert(dfitem_new->item->id);
             InventoryItem item_new(dfitem_new->item->id, *dfitem_new);
-            auto c = itemIdToInventoryItem.find(dfitem_new->item->id);
-            if ( c == itemIdToInventoryItem.end() ) {
+            auto c = v.begin();
+            while ( c != v.end() && c->itemId != item_new.itemId )
+                c++;
+            if ( c == v.end() ) {
                 //new item equipped (probably just picked up)
                 InventoryChangeData data(unit->id, NULL, &item_new);
                 for ( auto h = copy.begin(); h != copy.end(); h++ ) {
@@ -755,7 +779,7 @@ static void manageEquipmentEvent(color_ostream& out) {
                 }
                 continue;
             }
-            InventoryItem item_old = (*c).second;
+            InventoryItem item_old = *c;
 
             df::unit_inventory_item& item0 = item_old.item;
             df::unit_inventory_item& item1 = item_new.item;
@@ -771,9 +795,12 @@ static void manageEquipmentEvent(color_ostream& out) {
         }
         //check for dropped items
         for ( auto b = v.begin(); b != v.end(); b++ ) {
-            InventoryItem i = *b;
-            if ( currentlyEquipped.find(i.itemId) != currentlyEquipped.end() )
+            bool equipped = false;
+            for ( size_t c = 0; c < unit->inventory.size() && !equipped; c++ )
+                equipped = unit->inventory[c]->item->id == b->itemId;
+            if ( equipped )
                 continue;
+            InventoryItem i = *b;
             //TODO: delete ptr if invalid
             InventoryChangeData data(unit->id, &i, NULL);
             for ( auto h = copy.begin(); h != copy.end(); h++ ) {
@@ -781,17 +808,15 @@ static void manageEquipmentEvent(color_ostream& out) {
                 handle.eventHandler(out, (void*)&data);
             }
         }
-        if ( !hadEquipment )
-            delete temp;
 
-        //update equipment
-        vector<InventoryItem>& equipment = equipmentLog[unit->id];
-        equipment.clear();
+        //update equipment, reusing the vector's storage
+        v.clear();
         for ( size_t b = 0; b < unit->inventory.size(); b++ ) {
             df::unit_inventory_item* dfitem = unit->inventory[b];
-            InventoryItem item(dfitem->item->id, *dfitem);
-            equipment.push_back(item);
+            v.push_back(InventoryItem(dfitem->item->id, *dfitem));
         }
+        log.known = true;
+        log.fingerprint = fingerprint;
     }
 }
 
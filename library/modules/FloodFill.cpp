@@ -0,0 +1,197 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+
+#include "Internal.h"
+
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+#include "Core.h"
+#include "DataDefs.h"
+
+#include "modules/FloodFill.h"
+#include "modules/Maps.h"
+
+using namespace DFHack;
+using namespace DFHack::FloodFill;
+
+Engine::Engine(const TileTest &test, unsigned flags)
+    : test(test), flags(flags), xblocks(0), yblocks(0), zblocks(0)
+{
+    uint32_t x_max = 0, y_max = 0, z_max = 0;
+    if (Maps::IsValid())
+        Maps::getSize(x_max, y_max, z_max);
+
+    xblocks = x_max;
+    yblocks = y_max;
+    zblocks = z_max;
+
+    bmin = df::coord(0, 0, 0);
+    bmax = df::coord(xblocks*16 - 1, yblocks*16 - 1, zblocks - 1);
+}
+
+void Engine::setBounds(df::coord min, df::coord max)
+{
+    bmin = df::coord(std::max<int>(min.x, 0), std::max<int>(min.y, 0), std::max<int>(min.z, 0));
+    bmax = df::coord(std::min<int>(max.x, xblocks*16 - 1),
+                     std::min<int>(max.y, yblocks*16 - 1),
+                     std::min<int>(max.z, zblocks - 1));
+}
+
+void Engine::reset()
+{
+    block_slot.clear();
+    rows.clear();
+    seeds.clear();
+}
+
+uint16_t *Engine::rowMask(int x, int y, int z, bool create)
+{
+    if (block_slot.empty())
+    {
+        if (!create)
+            return NULL;
+        block_slot.resize(size_t(xblocks) * yblocks * zblocks, -1);
+    }
+
+    int32_t &slot = block_slot[blockIndex(x, y, z)];
+    if (slot < 0)
+    {
+        if (!create)
+            return NULL;
+        slot = int32_t(rows.size() / 16);
+        rows.resize(rows.size() + 16, 0);
+    }
+
+    return &rows[slot*16 + (y & 15)];
+}
+
+bool Engine::visited(int x, int y, int z) const
+{
+    if (block_slot.empty())
+        return false;
+    int32_t slot = block_slot[blockIndex(x, y, z)];
+    return slot >= 0 && (rows[slot*16 + (y & 15)] & (1 << (x & 15))) != 0;
+}
+
+bool Engine::isVisited(df::coord pos) const
+{
+    return inBounds(pos) && visited(pos.x, pos.y, pos.z);
+}
+
+void Engine::markSpan(int x1, int x2, int y, int z)
+{
+    // One word per block row; x1..x2 may cross block boundaries
+    while (x1 <= x2)
+    {
+        int end = std::min(x2, (x1 | 15));
+        uint16_t bits = uint16_t(((1u << (end - x1 + 1)) - 1) << (x1 & 15));
+        *rowMask(x1, y, z, true) |= bits;
+        x1 = end + 1;
+    }
+}
+
+void Engine::scanRow(int x1, int x2, int y, int z, int from_z)
+{
+    int dz = z - from_z;
+    int run_start = -1;
+
+    for (int x = x1; x <= x2; x++)
+    {
+        bool ok = (!dz || !vtest || vtest(df::coord(x, y, from_z), dz)) && accept(x, y, z);
+
+        if (ok && run_start < 0)
+            run_start = x;
+        else if (!ok && run_start >= 0)
+        {
+            seeds.push_back(Span{ int16_t(run_start), int16_t(x - 1), int16_t(y), int16_t(z) });
+            run_start = -1;
+        }
+    }
+
+    if (run_start >= 0)
+        seeds.push_back(Span{ int16_t(run_start), int16_t(x2), int16_t(y), int16_t(z) });
+}
+
+size_t Engine::fill(df::coord start, const TileVisitor &visit)
+{
+    if (!inBounds(start) || !accept(start.x, start.y, start.z))
+        return 0;
+
+    size_t count = 0;
+    seeds.push_back(Span{ start.x, start.x, start.y, start.z });
+
+    while (!seeds.empty())
+    {
+        Span span = seeds.back();
+        seeds.pop_back();
+
+        /*
+         * Seed spans consist of tiles that passed the test when they were
+         * queued. Since every maximal run of matching tiles is marked as
+         * a whole, a run is either completely visited or not at all.
+         */
+        if (visited(span.x1, span.y, span.z))
+            continue;
+
+        int y = span.y, z = span.z;
+        int x1 = span.x1, x2 = span.x2;
+
+        while (x1 > bmin.x && accept(x1 - 1, y, z))
+            x1--;
+        while (x2 < bmax.x && accept(x2 + 1, y, z))
+            x2++;
+
+        markSpan(x1, x2, y, z);
+
+        for (int x = x1; x <= x2; x++)
+            visit(df::coord(x, y, z));
+        count += x2 - x1 + 1;
+
+        int lo = x1, hi = x2;
+        if (flags & DIAGONAL)
+        {
+            lo = std::max<int>(x1 - 1, bmin.x);
+            hi = std::min<int>(x2 + 1, bmax.x);
+        }
+
+        if (y > bmin.y)
+            scanRow(lo, hi, y - 1, z, z);
+        if (y < bmax.y)
+            scanRow(lo, hi, y + 1, z, z);
+
+        if (flags & VERTICAL)
+        {
+            if (z > bmin.z)
+                scanRow(x1, x2, y, z - 1, z);
+            if (z < bmax.z)
+                scanRow(x1, x2, y, z + 1, z);
+        }
+    }
+
+    return count;
+}
@@ -114,6 +114,23 @@ using df::global::proj_next_id;
     ITEM(PANTS, pants, itemdef_pantsst) \
     ITEM(FOOD, food, itemdef_foodst)
 
+// One index per itemdef vector, dropped on world load and unload
+static std::map<df::item_type, RawTokenIndex> itemdef_indexes;
+
+void items_onStateChange(color_ostream &out, state_change_event event)
+{
+    switch (event) {
+    case SC_WORLD_LOADED:
+    case SC_WORLD_UNLOADED:
+        itemdef_indexes.clear();
+        break;
+    default:
+        break;
+    }
+}
+
+static const std::string &itemdef_id(df::itemdef *def) { return def->id; }
+
 int Items::getSubtypeCount(df::item_type itype)
 {
     using namespace df::enums::item_type;
@@ -228,13 +245,13 @@ bool ItemTypeInfo::find(const std::string &token)
 
     switch (type) {
 #define ITEM(type,vec,tclass) \
-    case type: \
-        for (size_t i = 0; i < defs.vec.size(); i++) { \
-            if (defs.vec[i]->id == items[1]) { \
-                subtype = i; custom = defs.vec[i]; return true; \
-            } \
+    case type: { \
+        int i = itemdef_indexes[type].find(defs.vec, items[1], itemdef_id); \
+        if (i >= 0) { \
+            subtype = i; custom = defs.vec[i]; return true; \
         } \
-        break;
+        break; \
+    }
 ITEMDEF_VECTORS
 #undef ITEM
 
@@ -28,6 +28,7 @@ distribution.
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <cassert>
 using namespace std;
 
@@ -58,6 +59,97 @@ using namespace std;
 using namespace DFHack;
 using namespace df::enums;
 
+/*
+ * Index of recently created jobs, shared by all listNewlyCreated callers
+ * within the update hooks of one Core::Update. DF cannot run while it is
+ * active, and linkIntoWorld and removeJob keep it current; jobs unlinked
+ * by hand are filtered out when entries are handed out. It is dropped
+ * before console, RPC and other suspended callers run.
+ */
+static struct {
+    bool active;
+    bool valid;
+    int32_t low_id;     // every job with id >= low_id is in jobs
+    int32_t next_id;    // value of job_next_id when last synchronized
+    std::vector<df::job*> jobs; // sorted by id
+} new_jobs;
+
+static bool job_id_less(df::job *job, int32_t id) { return job->id < id; }
+
+void jobs_beginUpdate()
+{
+    new_jobs.active = true;
+    new_jobs.valid = false;
+}
+
+void jobs_endUpdate()
+{
+    new_jobs.active = false;
+    new_jobs.valid = false;
+    new_jobs.jobs.clear();
+}
+
+static void rebuild_new_jobs(int32_t low_id)
+{
+    using df::global::world;
+    using df::global::job_next_id;
+
+    new_jobs.jobs.clear();
+    new_jobs.low_id = low_id;
+    new_jobs.next_id = *job_next_id;
+
+    bool sorted = true;
+    for (df::job_list_link *link = world->jobs.list.next; link; link = link->next)
+    {
+        df::job *job = link->item;
+        if (!job || job->id < low_id)
+            continue;
+        if (!new_jobs.jobs.empty() && new_jobs.jobs.back()->id > job->id)
+            sorted = false;
+        new_jobs.jobs.push_back(job);
+    }
+
+    if (!sorted)
+        std::sort(new_jobs.jobs.begin(), new_jobs.jobs.end(),
+                  [](df::job *a, df::job *b) { return a->id < b->id; });
+
+    new_jobs.valid = true;
+}
+
+static void index_linked_job(df::job *job)
+{
+    using df::global::job_next_id;
+
+    if (!new_jobs.valid || job->id < new_jobs.low_id)
+        return;
+
+    auto &jobs = new_jobs.jobs;
+    jobs.insert(std::lower_bound(jobs.begin(), jobs.end(), job->id, job_id_less), job);
+
+    if (new_jobs.next_id != *job_next_id)
+    {
+        // linkIntoWorld with new_id only advances job_next_id by one;
+        // anything else means jobs were created behind our back.
+        if (new_jobs.next_id + 1 == *job_next_id && job->id == new_jobs.next_id)
+            new_jobs.next_id = *job_next_id;
+        else
+            new_jobs.valid = false;
+    }
+}
+
+static void unindex_job(df::job *job)
+{
+    if (!new_jobs.valid || job->id < new_jobs.low_id)
+        return;
+
+    auto &jobs = new_jobs.jobs;
+    auto it = std::lower_bound(jobs.begin(), jobs.end(), job->id, job_id_less);
+    if (it != jobs.end() && *it == job)
+        jobs.erase(it);
+    else
+        new_jobs.valid = false;
+}
+
 df::job *DFHack::Job::cloneJobStruct(df::job *job, bool keepEverything)
 {
     CHECK_NULL_POINTER(job);
@@ -411,6 +503,8 @@ bool DFHack::Job::removeJob(df::job *job) {
 
     //Remove job from global list
     if (job->list_link) {
+        unindex_job(job);
+
         auto prev = job->list_link->prev;
         auto next = job->list_link->next;
 
@@ -485,6 +579,7 @@ bool DFHack::Job::linkIntoWorld(df::job *job, bool new_id)
         job->list_link = new df::job_list_link();
         job->list_link->item = job;
         linked_list_append(&world->jobs.list, job->list_link);
+        index_linked_job(job);
         return true;
     } else {
         df::job_list_link *ins_pos = &world->jobs.list;
@@ -497,6 +592,7 @@ bool DFHack::Job::linkIntoWorld(df::job *job, bool new_id)
         job->list_link = new df::job_list_link();
         job->list_link->item = job;
         linked_list_insert_after(ins_pos, job->list_link);
+        index_linked_job(job);
         return true;
     }
 }
@@ -545,6 +641,25 @@ bool DFHack::Job::listNewlyCreated(std::vector<df::job*> *pvec, int *id_var)
 
     *id_var = cur_id;
 
+    if (new_jobs.active)
+    {
+        // One walk serves every caller in this update; the list has no
+        // tail pointer, so finding new jobs otherwise means a full scan.
+        if (!new_jobs.valid || new_jobs.next_id != cur_id)
+            rebuild_new_jobs(new_jobs.valid ? std::min(old_id, new_jobs.low_id) : old_id);
+        else if (new_jobs.low_id > old_id)
+            rebuild_new_jobs(old_id);
+
+        auto &jobs = new_jobs.jobs;
+        for (auto it = std::lower_bound(jobs.begin(), jobs.end(), old_id, job_id_less); it != jobs.end(); ++it)
+        {
+            df::job *job = *it;
+            if (job->list_link && job->list_link->item == job)
+                pvec->push_back(job);
+        }
+        return true;
+    }
+
     pvec->reserve(std::min(20,cur_id - old_id));
 
     df::job_list_link *link = world->jobs.list.next;
@@ -31,6 +31,7 @@ distribution.
 #include <set>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 using namespace std;
 
 #include "ColorText.h"
@@ -585,6 +586,80 @@ bool Maps::canWalkBetween(df::coord pos1, df::coord pos2)
     return tile1 && tile1 == tile2;
 }
 
+bool Maps::readRegion(df::coord min, df::coord max, const TileRegionBuffers &out,
+                      MapExtras::MapCache *cache)
+{
+    if (!IsValid() || min.x > max.x || min.y > max.y || min.z > max.z)
+        return false;
+
+    size_t dim_x = max.x - min.x + 1;
+    size_t dim_y = max.y - min.y + 1;
+
+    bool want_mats = out.mat_type || out.mat_index;
+    std::unique_ptr<MapExtras::MapCache> own_cache;
+    if (want_mats && !cache)
+    {
+        own_cache.reset(new MapExtras::MapCache());
+        cache = own_cache.get();
+    }
+
+    for (int z = min.z; z <= max.z; z++)
+    {
+        for (int by = min.y >> 4; by <= max.y >> 4; by++)
+        {
+            int y0 = std::max<int>(min.y, by*16), y1 = std::min<int>(max.y, by*16 + 15);
+            for (int bx = min.x >> 4; bx <= max.x >> 4; bx++)
+            {
+                int x0 = std::max<int>(min.x, bx*16), x1 = std::min<int>(max.x, bx*16 + 15);
+                df::map_block *block = getBlock(bx, by, z);
+                MapExtras::Block *mblock = NULL;
+                if (block && want_mats)
+                    mblock = cache->BlockAt(df::coord(bx, by, z));
+
+                for (int y = y0; y <= y1; y++)
+                {
+                    size_t row = ((z - min.z) * dim_y + (y - min.y)) * dim_x;
+                    for (int x = x0; x <= x1; x++)
+                    {
+                        size_t idx = row + (x - min.x);
+                        if (!block)
+                        {
+                            if (out.tiletype) out.tiletype[idx] = tiletype::Void;
+                            if (out.shape) out.shape[idx] = tiletype_shape::NONE;
+                            if (out.tile_material) out.tile_material[idx] = tiletype_material::NONE;
+                            if (out.mat_type) out.mat_type[idx] = -1;
+                            if (out.mat_index) out.mat_index[idx] = -1;
+                            if (out.liquid_level) out.liquid_level[idx] = 0;
+                            if (out.liquid_type) out.liquid_type[idx] = tile_liquid::Water;
+                            if (out.designation) out.designation[idx] = 0;
+                            if (out.occupancy) out.occupancy[idx] = 0;
+                            continue;
+                        }
+
+                        df::tiletype tt = block->tiletype[x&15][y&15];
+                        const df::tile_designation &des = block->designation[x&15][y&15];
+                        if (out.tiletype) out.tiletype[idx] = tt;
+                        if (out.shape) out.shape[idx] = ENUM_ATTR(tiletype, shape, tt);
+                        if (out.tile_material) out.tile_material[idx] = ENUM_ATTR(tiletype, material, tt);
+                        if (want_mats)
+                        {
+                            t_matpair mat = mblock ? mblock->staticMaterialAt(df::coord2d(x&15, y&15))
+                                                   : t_matpair();
+                            if (out.mat_type) out.mat_type[idx] = mat.mat_type;
+                            if (out.mat_index) out.mat_index[idx] = mat.mat_index;
+                        }
+                        if (out.liquid_level) out.liquid_level[idx] = des.bits.flow_size;
+                        if (out.liquid_type) out.liquid_type[idx] = df::tile_liquid(des.bits.liquid_type);
+                        if (out.designation) out.designation[idx] = des.whole;
+                        if (out.occupancy) out.occupancy[idx] = block->occupancy[x&15][y&15].whole;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
 bool Maps::canStepBetween(df::coord pos1, df::coord pos2)
 {
     color_ostream& out = Core::getInstance().getConsole();
@@ -208,6 +208,53 @@ bool MaterialInfo::find(const std::vector<std::string> &items)
     return false;
 }
 
+/*
+ * Token lookups. These used to scan the raw vectors comparing strings;
+ * the indexes are rebuilt lazily after being dropped on world load and
+ * unload, which is when DF re-reads the raws.
+ */
+static RawTokenIndex builtin_index, inorganic_index, plant_index, creature_index;
+static unsigned raw_token_generation = 1;
+
+void DFHack::invalidateRawTokenIndexes()
+{
+    raw_token_generation++;
+}
+
+unsigned DFHack::getRawTokenGeneration()
+{
+    return raw_token_generation;
+}
+
+void materials_onStateChange(color_ostream &out, state_change_event event)
+{
+    switch (event) {
+    case SC_WORLD_LOADED:
+    case SC_WORLD_UNLOADED:
+        builtin_index.clear();
+        inorganic_index.clear();
+        plant_index.clear();
+        creature_index.clear();
+        break;
+    default:
+        break;
+    }
+}
+
+static const std::string &material_id(df::material *mat) { return mat->id; }
+static const std::string &inorganic_id(df::inorganic_raw *raw) { return raw->id; }
+static const std::string &plant_id(df::plant_raw *raw) { return raw->id; }
+static const std::string &creature_id(df::creature_raw *raw) { return raw->creature_id; }
+
+static int find_material_id(const std::vector<df::material*> &mats, const std::string &token)
+{
+    // Per-raw material lists are short, so these stay linear
+    for (size_t j = 0; j < mats.size(); j++)
+        if (mats[j]->id == token)
+            return j;
+    return -1;
+}
+
 bool MaterialInfo::findBuiltin(const std::string &token)
 {
     if (token.empty())
@@ -218,13 +265,9 @@ bool MaterialInfo::findBuiltin(const std::string &token)
         return true;
     }
 
-    df::world_raws &raws = world->raws;
-    for (int i = 0; i < NUM_BUILTIN; i++)
-    {
-        auto obj = raws.mat_table.builtin[i];
-        if (obj && obj->id == token)
-            return decode(i, -1);
-    }
+    int i = builtin_index.find(world->raws.mat_table.builtin, NUM_BUILTIN, token, material_id);
+    if (i >= 0)
+        return decode(i, -1);
     return decode(-1);
 }
 
@@ -238,13 +281,9 @@ bool MaterialInfo::findInorganic(const std::string &token)
         return true;
     }
 
-    df::world_raws &raws = world->raws;
-    for (size_t i = 0; i < raws.inorganics.size(); i++)
-    {
-        df::inorganic_raw *p = raws.inorganics[i];
-        if (p->id == token)
-            return decode(0, i);
-    }
+    int i = inorganic_index.find(world->raws.inorganics, token, inorganic_id);
+    if (i >= 0)
+        return decode(0, i);
     return decode(-1);
 }
 
@@ -252,23 +291,20 @@ bool MaterialInfo::findPlant(const std::string &token, const std::string &subtok
 {
     if (token.empty())
         return decode(-1);
-    df::world_raws &raws = world->raws;
-    for (size_t i = 0; i < raws.plants.all.size(); i++)
-    {
-        df::plant_raw *p = raws.plants.all[i];
-        if (p->id != token)
-            continue;
+    auto &plants = world->raws.plants.all;
+    int i = plant_index.find(plants, token, plant_id);
+    if (i < 0)
+        return decode(-1);
 
-        // As a special exception, return the structural material with empty subtoken
-        if (subtoken.empty())
-            return decode(p->material_defs.type_basic_mat, p->material_defs.idx_basic_mat);
+    df::plant_raw *p = plants[i];
 
-        for (size_t j = 0; j < p->material.size(); j++)
-            if (p->material[j]->id == subtoken)
-                return decode(PLANT_BASE+j, i);
+    // As a special exception, return the structural material with empty subtoken
+    if (subtoken.empty())
+        return decode(p->material_defs.type_basic_mat, p->material_defs.idx_basic_mat);
 
-        break;
-    }
+    int j = find_material_id(p->material, subtoken);
+    if (j >= 0)
+        return decode(PLANT_BASE+j, i);
     return decode(-1);
 }
 
@@ -276,19 +312,14 @@ bool MaterialInfo::findCreature(const std::string &token, const std::string &sub
 {
     if (token.empty() || subtoken.empty())
         return decode(-1);
-    df::world_raws &raws = world->raws;
-    for (size_t i = 0; i < raws.creatures.all.size(); i++)
-    {
-        df::creature_raw *p = raws.creatures.all[i];
-        if (p->creature_id != token)
-            continue;
-
-        for (size_t j = 0; j < p->material.size(); j++)
-            if (p->material[j]->id == subtoken)
-                return decode(CREATURE_BASE+j, i);
+    auto &creatures = world->raws.creatures.all;
+    int i = creature_index.find(creatures, token, creature_id);
+    if (i < 0)
+        return decode(-1);
 
-        break;
-    }
+    int j = find_material_id(creatures[i]->material, subtoken);
+    if (j >= 0)
+        return decode(CREATURE_BASE+j, i);
     return decode(-1);
 }
 
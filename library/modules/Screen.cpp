@@ -180,6 +180,129 @@ Pen Screen::readTile(int x, int y, bool map)
     return doGetTile(x, y, map);
 }
 
+Pen Screen::TileSnapshot::get(size_t idx) const
+{
+    Pen pen(ch[idx], fg[idx], bg[idx], bold[idx] != 0, tile[idx]);
+    pen.tile_mode = Pen::TileMode(tile_mode[idx]);
+    pen.tile_fg = tile_fg[idx];
+    pen.tile_bg = tile_bg[idx];
+    return pen;
+}
+
+namespace {
+    // Stores one decoded tile, noting whether it differs from what was there
+    struct snapshot_writer {
+        Screen::TileSnapshot *snap;
+        bool had_data;
+
+        inline void store(size_t idx, uint8_t ch, uint8_t fg, uint8_t bg, uint8_t bold,
+                          int32_t tile, uint8_t mode, int8_t tile_fg, int8_t tile_bg)
+        {
+            auto &s = *snap;
+            bool diff = !had_data ||
+                s.ch[idx] != ch || s.fg[idx] != fg || s.bg[idx] != bg ||
+                s.bold[idx] != bold || s.tile[idx] != tile || s.tile_mode[idx] != mode ||
+                s.tile_fg[idx] != tile_fg || s.tile_bg[idx] != tile_bg;
+            if (!diff)
+                return;
+            s.ch[idx] = ch; s.fg[idx] = fg; s.bg[idx] = bg; s.bold[idx] = bold;
+            s.tile[idx] = tile; s.tile_mode[idx] = mode;
+            s.tile_fg[idx] = tile_fg; s.tile_bg[idx] = tile_bg;
+            s.changed[idx >> 6] |= uint64_t(1) << (idx & 63);
+            s.num_changed++;
+        }
+    };
+}
+
+bool Screen::readRect(TileSnapshot *snap, int x1, int y1, int x2, int y2, bool map)
+{
+    CHECK_NULL_POINTER(snap);
+
+    auto dim = getWindowSize();
+    x1 = std::max(x1, 0);
+    y1 = std::max(y1, 0);
+    x2 = std::min(x2, dim.x-1);
+    y2 = std::min(y2, dim.y-1);
+    if (!gps || x1 > x2 || y1 > y2)
+    {
+        *snap = TileSnapshot();
+        return false;
+    }
+
+    rect2d area(df::coord2d(x1, y1), df::coord2d(x2, y2));
+    snapshot_writer out = { snap, snap->area == area && snap->size() > 0 };
+    if (!out.had_data)
+    {
+        snap->area = area;
+        snap->width = x2 - x1 + 1;
+        snap->height = y2 - y1 + 1;
+        size_t count = snap->size();
+        snap->ch.resize(count); snap->fg.resize(count);
+        snap->bg.resize(count); snap->bold.resize(count);
+        snap->tile.resize(count); snap->tile_mode.resize(count);
+        snap->tile_fg.resize(count); snap->tile_bg.resize(count);
+    }
+    snap->changed.assign((snap->size() + 63) / 64, 0);
+    snap->num_changed = 0;
+
+    // Someone else decides what the screen contains; ask them tile by tile
+    if (GUI_HOOK_TOP(Screen::Hooks::get_tile) != doGetTile_default)
+    {
+        size_t idx = 0;
+        for (int x = x1; x <= x2; x++)
+        {
+            for (int y = y1; y <= y2; y++, idx++)
+            {
+                Pen pen = doGetTile(x, y, map);
+                out.store(idx, pen.ch, pen.fg, pen.bg, pen.bold, pen.tile,
+                          pen.tile_mode, pen.tile_fg, pen.tile_bg);
+            }
+        }
+        return true;
+    }
+
+    // Same decoding as doGetTile_default, walking each column of the
+    // buffers in order
+    size_t idx = 0;
+    for (int x = x1; x <= x2; x++)
+    {
+        int base = x*dim.y;
+        auto screen = gps->screen + (base + y1)*4;
+        auto texpos = gps->screentexpos + base;
+        auto addcolor = gps->screentexpos_addcolor + base;
+        auto grayscale = gps->screentexpos_grayscale + base;
+        auto cf = gps->screentexpos_cf + base;
+        auto cbr = gps->screentexpos_cbr + base;
+
+        for (int y = y1; y <= y2; y++, idx++, screen += 4)
+        {
+            if (screen[3] & 0x80)
+            {
+                out.store(idx, 0, 0, 0, 0, -1, Pen::AsIs, 0, 0);
+                continue;
+            }
+
+            int32_t tile = texpos[y];
+            uint8_t mode = Pen::AsIs;
+            int8_t tile_fg = 0, tile_bg = 0;
+            if (tile)
+            {
+                if (grayscale[y])
+                {
+                    mode = Pen::TileColor;
+                    tile_fg = cf[y];
+                    tile_bg = cbr[y];
+                }
+                else if (addcolor[y])
+                    mode = Pen::CharColor;
+            }
+            out.store(idx, screen[0], screen[1], screen[2], screen[3] ? 1 : 0,
+                      tile, mode, tile_fg, tile_bg);
+        }
+    }
+    return true;
+}
+
 bool Screen::paintString(const Pen &pen, int x, int y, const std::string &text, bool map)
 {
     auto dim = getWindowSize();
@@ -510,6 +633,25 @@ void PenArray::draw(unsigned int x, unsigned int y, unsigned int width, unsigned
     }
 }
 
+void PenArray::read(unsigned int x, unsigned int y, unsigned int width, unsigned int height,
+                    unsigned int bufx, unsigned int bufy)
+{
+    if (!width || !height)
+        return;
+    Screen::TileSnapshot snap;
+    if (!Screen::readRect(&snap, x, y, x + width - 1, y + height - 1))
+        return;
+    for (int gridx = snap.area.first.x; gridx <= snap.area.second.x; gridx++)
+    {
+        for (int gridy = snap.area.first.y; gridy <= snap.area.second.y; gridy++)
+        {
+            if (gridx - x + bufx >= dimx || gridy - y + bufy >= dimy)
+                continue;
+            buffer[((gridy - y + bufy) * dimx) + (gridx - x + bufx)] = snap.get(snap.index(gridx, gridy));
+        }
+    }
+}
+
 /*
  * Base DFHack viewscreen.
  */
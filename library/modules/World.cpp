@@ -24,9 +24,11 @@ distribution.
 
 
 #include "Internal.h"
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <map>
+#include <cstdlib>
 #include <cstring>
 using namespace std;
 
@@ -60,6 +62,26 @@ static int next_persistent_id = 0;
 static std::multimap<std::string, int> persistent_index;
 typedef std::pair<std::string, int> T_persistent_item;
 
+// Fake histfigs holding chunks of the key/value store are named with this
+// prefix followed by "<chunk>.<page>", and kept out of persistent_index.
+static const std::string store_chunk_prefix = "__dfhack_store__/";
+static const int store_num_chunks = 32;
+// DF saves string lengths as 16-bit shorts; a chunk whose encoding exceeds
+// this is split over several pages, each in its own histfig.
+static const size_t store_page_size = 30000;
+
+struct store_record
+{
+    uint8_t type;
+    std::string data;
+};
+typedef std::map<std::string, store_record> store_chunk;
+
+static bool store_loaded = false;
+static store_chunk store_chunks[store_num_chunks];
+static std::vector<int> store_chunk_ids[store_num_chunks];
+static uint32_t store_dirty = 0;
+
 bool World::ReadPauseState()
 {
     return DF_GLOBAL_VALUE(pause_state, false);
@@ -226,6 +248,14 @@ void World::ClearPersistentCache()
     next_persistent_id = 0;
     persistent_index.clear();
 
+    store_loaded = false;
+    store_dirty = 0;
+    for (int i = 0; i < store_num_chunks; i++)
+    {
+        store_chunks[i].clear();
+        store_chunk_ids[i].clear();
+    }
+
     INTERPOSE_HOOK(hide_fake_histfigs_hook, feed).apply(Core::getInstance().isWorldLoaded());
 }
 
@@ -253,6 +283,8 @@ static bool BuildPersistentCache()
     {
         if (!hfvec[i]->name.has_name || hfvec[i]->name.first_name.empty())
             continue;
+        if (hfvec[i]->name.first_name.compare(0, store_chunk_prefix.size(), store_chunk_prefix) == 0)
+            continue;
 
         persistent_index.insert(T_persistent_item(hfvec[i]->name.first_name, -hfvec[i]->id));
     }
@@ -260,11 +292,8 @@ static bool BuildPersistentCache()
     return true;
 }
 
-PersistentDataItem World::AddPersistentData(const std::string &key)
+static df::historical_figure *AddFakeHistFig(const std::string &key)
 {
-    if (!BuildPersistentCache() || key.empty())
-        return PersistentDataItem();
-
     std::vector<df::historical_figure*> &hfvec = df::historical_figure::get_vector();
 
     df::historical_figure *hfig = new df::historical_figure();
@@ -278,6 +307,27 @@ PersistentDataItem World::AddPersistentData(const std::string &key)
     next_persistent_id = hfig->id-1;
 
     hfvec.insert(hfvec.begin(), hfig);
+    return hfig;
+}
+
+static void DeleteFakeHistFig(int id)
+{
+    std::vector<df::historical_figure*> &hfvec = df::historical_figure::get_vector();
+
+    int idx = binsearch_index(hfvec, id);
+
+    if (idx >= 0) {
+        delete hfvec[idx];
+        hfvec.erase(hfvec.begin()+idx);
+    }
+}
+
+PersistentDataItem World::AddPersistentData(const std::string &key)
+{
+    if (!BuildPersistentCache() || key.empty())
+        return PersistentDataItem();
+
+    df::historical_figure *hfig = AddFakeHistFig(key);
 
     persistent_index.insert(T_persistent_item(key, -hfig->id));
 
@@ -367,8 +417,6 @@ bool World::DeletePersistentData(const PersistentDataItem &item)
     if (!BuildPersistentCache())
         return false;
 
-    std::vector<df::historical_figure*> &hfvec = df::historical_figure::get_vector();
-
     auto eqrange = persistent_index.equal_range(item.key());
 
     for (auto it2 = eqrange.first; it2 != eqrange.second; )
@@ -380,17 +428,342 @@ bool World::DeletePersistentData(const PersistentDataItem &item)
 
         persistent_index.erase(it);
 
-        int idx = binsearch_index(hfvec, id);
+        DeleteFakeHistFig(id);
+
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Key/value store. Records are spread over a fixed number of chunks by key
+ * hash; each chunk is serialized into the nicknames of one or more fake
+ * histfigs (pages) as
+ *   "DFS1" { varint key_len, key, u8 type, varint data_len, data }*
+ * with NUL escaped, since DF serialization chokes on NUL bytes.
+ */
+
+static int store_chunk_of(const std::string &key)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < key.size(); i++)
+        hash = (hash ^ uint8_t(key[i])) * 16777619u;
+    return hash % store_num_chunks;
+}
+
+static void put_varint(std::string &out, size_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(char(uint8_t(value) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+static bool get_varint(const std::string &in, size_t &pos, size_t &value)
+{
+    value = 0;
+    for (int shift = 0; pos < in.size() && shift < 64; shift += 7)
+    {
+        uint8_t b = in[pos++];
+        value |= size_t(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
 
-        if (idx >= 0) {
-            delete hfvec[idx];
-            hfvec.erase(hfvec.begin()+idx);
+// 0x00 -> 0x01 0x01, 0x01 -> 0x01 0x02
+static std::string escape_nul(const std::string &in)
+{
+    std::string out;
+    out.reserve(in.size() + in.size()/64);
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        uint8_t b = in[i];
+        if (b <= 1)
+        {
+            out.push_back('\x01');
+            out.push_back(char(b+1));
         }
+        else
+            out.push_back(char(b));
+    }
+    return out;
+}
+
+static std::string unescape_nul(const std::string &in)
+{
+    std::string out;
+    out.reserve(in.size());
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        if (in[i] == '\x01' && i+1 < in.size())
+            out.push_back(char(in[++i]-1));
+        else
+            out.push_back(in[i]);
+    }
+    return out;
+}
+
+// Escaping is bytewise, so escaped records can simply be concatenated.
+static std::string encode_store_record(const std::string &key, uint8_t type, const std::string &data)
+{
+    std::string out;
+    put_varint(out, key.size());
+    out += key;
+    out.push_back(char(type));
+    put_varint(out, data.size());
+    out += data;
+    return escape_nul(out);
+}
 
+static bool store_record_fits(const std::string &key, uint8_t type, const std::string &data)
+{
+    return 4 + encode_store_record(key, type, data).size() <= store_page_size;
+}
+
+// Each page is a complete "DFS1" encoding of a subset of the records.
+static void encode_store_chunk(const store_chunk &chunk, std::vector<std::string> &pages)
+{
+    pages.clear();
+    for (auto it = chunk.begin(); it != chunk.end(); ++it)
+    {
+        std::string rec = encode_store_record(it->first, it->second.type, it->second.data);
+        if (pages.empty() || pages.back().size() + rec.size() > store_page_size)
+            pages.push_back("DFS1");
+        pages.back() += rec;
+    }
+}
+
+static bool decode_store_chunk(const std::string &escaped, store_chunk &chunk)
+{
+    std::string in = unescape_nul(escaped);
+    if (in.compare(0, 4, "DFS1") != 0)
+        return false;
+
+    size_t pos = 4, len;
+    while (pos < in.size())
+    {
+        if (!get_varint(in, pos, len) || len > in.size() - pos)
+            return false;
+        std::string key = in.substr(pos, len);
+        pos += len;
+        if (pos >= in.size())
+            return false;
+        store_record &rec = chunk[key];
+        rec.type = in[pos++];
+        if (!get_varint(in, pos, len) || len > in.size() - pos)
+            return false;
+        rec.data = in.substr(pos, len);
+        pos += len;
+    }
+    return true;
+}
+
+static bool LoadPersistentStore()
+{
+    if (store_loaded)
         return true;
+    if (!BuildPersistentCache())
+        return false;
+
+    for (int i = 0; i < store_num_chunks; i++)
+        store_chunk_ids[i].clear();
+
+    std::vector<df::historical_figure*> &hfvec = df::historical_figure::get_vector();
+    for (size_t i = 0; i < hfvec.size() && hfvec[i]->id <= -100; i++)
+    {
+        auto &name = hfvec[i]->name;
+        if (!name.has_name || name.first_name.compare(0, store_chunk_prefix.size(), store_chunk_prefix) != 0)
+            continue;
+
+        int chunk = atoi(name.first_name.c_str() + store_chunk_prefix.size());
+        if (chunk < 0 || chunk >= store_num_chunks)
+            continue;
+
+        store_chunk_ids[chunk].push_back(hfvec[i]->id);
+        if (!decode_store_chunk(name.nickname, store_chunks[chunk]))
+            Core::printerr("Persistent store chunk %d is corrupt; some records were lost.\n", chunk);
     }
 
-    return false;
+    store_loaded = true;
+    return true;
+}
+
+// The first legacy item with this key, if any
+static PersistentDataItem FindLegacyItem(const std::string &key)
+{
+    auto it = persistent_index.find(key);
+    if (it == persistent_index.end())
+        return PersistentDataItem();
+    return World::GetPersistentData(it->second);
+}
+
+// Encodes a legacy item as a PERSIST_LEGACY value, without touching it
+static std::string EncodeLegacyItem(const PersistentDataItem &item)
+{
+    std::string data;
+    for (int i = 0; i < PersistentDataItem::NumInts; i++)
+    {
+        uint32_t v = uint32_t(item.ival(i));
+        for (int b = 0; b < 4; b++)
+            data.push_back(char(v >> (8*b)));
+    }
+    data += item.val();
+    return data;
+}
+
+// Writing or deleting a key through the store completes its migration: the
+// legacy item is removed, so older builds and GetPersistentData no longer
+// see it.
+static void DropLegacyItem(const std::string &key, bool *found = NULL)
+{
+    PersistentDataItem item = FindLegacyItem(key);
+    if (item.isValid())
+    {
+        World::DeletePersistentData(item);
+        if (found)
+            *found = true;
+    }
+}
+
+bool World::SetPersistentValue(const std::string &key, const std::string &data, uint8_t type)
+{
+    if (key.empty() || !store_record_fits(key, type, data) || !LoadPersistentStore())
+        return false;
+
+    int chunk = store_chunk_of(key);
+    store_record &rec = store_chunks[chunk][key];
+    rec.type = type;
+    rec.data = data;
+    store_dirty |= 1u << chunk;
+
+    DropLegacyItem(key);
+    return true;
+}
+
+bool World::GetPersistentValue(const std::string &key, std::string *data, uint8_t *type)
+{
+    if (!LoadPersistentStore())
+        return false;
+
+    store_chunk &chunk = store_chunks[store_chunk_of(key)];
+    auto it = chunk.find(key);
+    if (it == chunk.end())
+    {
+        // Read through to a legacy item, leaving it in place
+        PersistentDataItem item = FindLegacyItem(key);
+        if (!item.isValid())
+            return false;
+        if (data)
+            *data = EncodeLegacyItem(item);
+        if (type)
+            *type = PERSIST_LEGACY;
+        return true;
+    }
+
+    if (data)
+        *data = it->second.data;
+    if (type)
+        *type = it->second.type;
+    return true;
+}
+
+bool World::SetPersistentInt(const std::string &key, int64_t value)
+{
+    std::string data;
+    for (int b = 0; b < 8; b++)
+        data.push_back(char(uint64_t(value) >> (8*b)));
+    return SetPersistentValue(key, data, PERSIST_INT);
+}
+
+bool World::GetPersistentInt(const std::string &key, int64_t *value)
+{
+    std::string data;
+    uint8_t type;
+    if (!GetPersistentValue(key, &data, &type) || type != PERSIST_INT || data.size() != 8)
+        return false;
+
+    uint64_t v = 0;
+    for (int b = 0; b < 8; b++)
+        v |= uint64_t(uint8_t(data[b])) << (8*b);
+    *value = int64_t(v);
+    return true;
+}
+
+bool World::DeletePersistentValue(const std::string &key)
+{
+    if (!LoadPersistentStore())
+        return false;
+
+    int chunk = store_chunk_of(key);
+    bool found = false;
+    if (store_chunks[chunk].erase(key))
+    {
+        store_dirty |= 1u << chunk;
+        found = true;
+    }
+    DropLegacyItem(key, &found);
+    return found;
+}
+
+void World::ListPersistentValues(std::vector<std::string> *keys, const std::string &prefix)
+{
+    keys->clear();
+
+    if (!LoadPersistentStore())
+        return;
+
+    for (int i = 0; i < store_num_chunks; i++)
+    {
+        store_chunk &chunk = store_chunks[i];
+        for (auto it = chunk.lower_bound(prefix);
+             it != chunk.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+            keys->push_back(it->first);
+    }
+
+    std::sort(keys->begin(), keys->end());
+}
+
+void World::FlushPersistentStore()
+{
+    if (!store_loaded || !store_dirty || in_export_xml)
+        return;
+
+    for (int i = 0; i < store_num_chunks; i++)
+    {
+        if (!(store_dirty & (1u << i)))
+            continue;
+
+        std::vector<std::string> pages;
+        encode_store_chunk(store_chunks[i], pages);
+
+        auto &ids = store_chunk_ids[i];
+        while (ids.size() > pages.size())
+        {
+            DeleteFakeHistFig(ids.back());
+            ids.pop_back();
+        }
+
+        for (size_t page = 0; page < pages.size(); page++)
+        {
+            auto hfig = page < ids.size() ? df::historical_figure::find(ids[page]) : NULL;
+            if (!hfig)
+            {
+                hfig = AddFakeHistFig(stl_sprintf("%s%d.%d", store_chunk_prefix.c_str(), i, int(page)));
+                if (page < ids.size())
+                    ids[page] = hfig->id;
+                else
+                    ids.push_back(hfig->id);
+            }
+            hfig->name.nickname.swap(pages[page]);
+        }
+    }
+
+    store_dirty = 0;
 }
 
 df::tile_bitmask *World::getPersistentTilemask(const PersistentDataItem &item, df::map_block *block, bool create)
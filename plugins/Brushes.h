@@ -5,6 +5,8 @@
 #include <stack>
 #include <set>
 
+#include "modules/FloodFill.h"
+
 typedef vector <df::coord> coord_vec;
 class Brush
 {
@@ -159,39 +161,21 @@ public:
         using namespace DFHack;
         coord_vec v;
 
-        std::stack<DFCoord> to_flood;
-        to_flood.push(start);
-
-        std::set<DFCoord> seen;
-
-        while (!to_flood.empty()) {
-            DFCoord xy = to_flood.top();
-            to_flood.pop();
-
-                        df::tile_designation des = mc.designationAt(xy);
+        FloodFill::Engine filler([&](DFCoord pos) {
+            if (!mc.testCoord(pos))
+                return false;
+            df::tile_designation des = mc.designationAt(pos);
+            return des.bits.flow_size && des.bits.liquid_type == tile_liquid::Water;
+        }, FloodFill::VERTICAL);
 
-            if (seen.find(xy) == seen.end()
-                            && des.bits.flow_size
-                            && des.bits.liquid_type == tile_liquid::Water) {
-                v.push_back(xy);
-                seen.insert(xy);
+        filler.setVerticalTest([&](DFCoord pos, int dz) {
+            df::tiletype tt = mc.tiletypeAt(pos);
+            return dz < 0 ? LowPassable(tt) : HighPassable(tt);
+        });
 
-                maybeFlood(DFCoord(xy.x - 1, xy.y, xy.z), to_flood, mc);
-                maybeFlood(DFCoord(xy.x + 1, xy.y, xy.z), to_flood, mc);
-                maybeFlood(DFCoord(xy.x, xy.y - 1, xy.z), to_flood, mc);
-                maybeFlood(DFCoord(xy.x, xy.y + 1, xy.z), to_flood, mc);
-
-                df::tiletype tt = mc.tiletypeAt(xy);
-                if (LowPassable(tt))
-                {
-                    maybeFlood(DFCoord(xy.x, xy.y, xy.z - 1), to_flood, mc);
-                }
-                if (HighPassable(tt))
-                {
-                    maybeFlood(DFCoord(xy.x, xy.y, xy.z + 1), to_flood, mc);
-                }
-            }
-        }
+        filler.fill(start, [&](DFCoord pos) {
+            v.push_back(pos);
+        });
 
         return v;
     }
@@ -199,12 +183,6 @@ public:
         return "flood";
     }
 private:
-    void maybeFlood(DFHack::DFCoord c, std::stack<DFHack::DFCoord> &to_flood,
-                    MapExtras::MapCache &mc) {
-        if (mc.testCoord(c)) {
-            to_flood.push(c);
-        }
-    }
     DFHack::Core *c_;
 };
 
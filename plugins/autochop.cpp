@@ -10,6 +10,7 @@
 #include "DataDefs.h"
 #include "TileTypes.h"
 
+#include "df/block_burrow.h"
 #include "df/burrow.h"
 #include "df/item.h"
 #include "df/item_flags.h"
@@ -32,7 +33,9 @@
 #include "modules/Screen.h"
 #include "modules/World.h"
 
+#include <algorithm>
 #include <set>
+#include <unordered_map>
 
 using std::string;
 using std::vector;
@@ -142,6 +145,25 @@ public:
         return false;
     }
 
+    // Collects the masks of the watched burrows that touch this block.
+    // Returns false if the block lies outside all of them.
+    bool getBlockMasks(df::map_block *block, vector<df::block_burrow*> *masks)
+    {
+        validate();
+        masks->clear();
+        if (!burrows.size())
+            return true;
+
+        for (auto it = burrows.begin(); it != burrows.end(); it++)
+        {
+            auto mask = Burrows::getBlockMask(it->burrow, block);
+            if (mask)
+                masks->push_back(mask);
+        }
+
+        return !masks->empty();
+    }
+
     bool isBurrowWatched(const df::burrow *burrow)
     {
         validate();
@@ -230,7 +252,46 @@ static void initialize()
     }
 }
 
-static bool skip_plant(const df::plant * plant, bool *restricted)
+/*
+ * Per-species properties that decide whether a tree may be cut. These use
+ * the same bits as Skip, so a species is restricted if (flags & skip).
+ */
+static vector<uint8_t> species_flags;
+
+static uint8_t get_species_flags(int32_t index)
+{
+    auto &raws = world->raws.plants.all;
+
+    if (species_flags.size() != raws.size())
+    {
+        species_flags.assign(raws.size(), 0);
+
+        for (size_t i = 0; i < raws.size(); i++)
+        {
+            auto plant_raw = raws[i];
+            uint8_t flags = 0;
+
+            if (plant_raw->material_defs.type_drink != -1)
+                flags |= 1;
+
+            for (df::material * mat : plant_raw->material)
+            {
+                if (mat->flags.is_set(material_flags::EDIBLE_RAW))
+                    flags |= 2;
+                if (mat->flags.is_set(material_flags::EDIBLE_COOKED))
+                    flags |= 4;
+            }
+
+            species_flags[i] = flags;
+        }
+    }
+
+    if (index < 0 || size_t(index) >= species_flags.size())
+        return 0;
+    return species_flags[index];
+}
+
+static bool skip_plant(const df::plant * plant, df::map_block *cur, bool *restricted)
 {
     if (restricted)
         *restricted = false;
@@ -240,7 +301,6 @@ static bool skip_plant(const df::plant * plant, bool *restricted)
         return true;
 
     // Skip plants with invalid tile.
-    df::map_block *cur = Maps::getTileBlock(plant->pos);
     if (!cur)
         return true;
 
@@ -255,36 +315,137 @@ static bool skip_plant(const df::plant * plant, bool *restricted)
     if (material != tiletype_material::TREE)
         return true;
 
-    const df::plant_raw *plant_raw = df::plant_raw::find(plant->material);
-
-    // Skip fruit trees if set.
-    if (skip.fruit_trees && plant_raw->material_defs.type_drink != -1)
+    // Skip fruit, food and cooking trees if set.
+    if (get_species_flags(plant->material) & int(skip))
     {
         if (restricted)
             *restricted = true;
         return true;
     }
 
-    if (skip.food_trees || skip.cook_trees)
+    return false;
+}
+
+static bool skip_plant(const df::plant * plant, bool *restricted)
+{
+    return skip_plant(plant, Maps::getTileBlock(plant->pos), restricted);
+}
+
+/*
+ * Trees grouped by the map block they stand in. The index follows
+ * world->plants.tree_dry and tree_wet: when they differ from the last
+ * check, only the trees that appeared or vanished are moved.
+ */
+class TreeIndex
+{
+public:
+    struct Bucket {
+        df::map_block *block;
+        vector<df::plant*> trees;
+    };
+
+    vector<Bucket> buckets;
+
+    void clear()
+    {
+        buckets.clear();
+        bucket_ids.clear();
+        plant_bucket.clear();
+        snapshot.clear();
+        known.clear();
+    }
+
+    void sync()
+    {
+        auto &dry = world->plants.tree_dry;
+        auto &wet = world->plants.tree_wet;
+
+        if (snapshot.size() == dry.size() + wet.size() &&
+            std::equal(dry.begin(), dry.end(), snapshot.begin()) &&
+            std::equal(wet.begin(), wet.end(), snapshot.begin() + dry.size()))
+            return;
+
+        snapshot.assign(dry.begin(), dry.end());
+        snapshot.insert(snapshot.end(), wet.begin(), wet.end());
+
+        vector<df::plant*> current(snapshot);
+        std::sort(current.begin(), current.end());
+
+        vector<df::plant*> changed;
+        std::set_difference(known.begin(), known.end(), current.begin(), current.end(),
+                            std::back_inserter(changed));
+        for (auto plant : changed)
+            remove(plant);
+
+        changed.clear();
+        std::set_difference(current.begin(), current.end(), known.begin(), known.end(),
+                            std::back_inserter(changed));
+        for (auto plant : changed)
+            add(plant);
+
+        known.swap(current);
+    }
+
+private:
+    std::unordered_map<df::map_block*, size_t> bucket_ids;
+    std::unordered_map<df::plant*, size_t> plant_bucket;
+    vector<df::plant*> snapshot;   // tree_dry then tree_wet, as last seen
+    vector<df::plant*> known;      // the same, sorted
+
+    void add(df::plant *plant)
     {
-        for (df::material * mat : plant_raw->material)
+        auto block = Maps::getTileBlock(plant->pos);
+        if (!block)
+            return;
+
+        auto it = bucket_ids.find(block);
+        size_t id;
+        if (it != bucket_ids.end())
+            id = it->second;
+        else
         {
-            if (skip.food_trees && mat->flags.is_set(material_flags::EDIBLE_RAW))
-            {
-                if (restricted)
-                    *restricted = true;
-                return true;
-            }
+            id = buckets.size();
+            bucket_ids[block] = id;
+            buckets.push_back(Bucket());
+            buckets.back().block = block;
+        }
 
-            if (skip.cook_trees && mat->flags.is_set(material_flags::EDIBLE_COOKED))
-            {
-                if (restricted)
-                    *restricted = true;
-                return true;
-            }
+        buckets[id].trees.push_back(plant);
+        plant_bucket[plant] = id;
+    }
+
+    void remove(df::plant *plant)
+    {
+        auto it = plant_bucket.find(plant);
+        if (it == plant_bucket.end())
+            return;
+
+        auto &trees = buckets[it->second].trees;
+        auto pos = std::find(trees.begin(), trees.end(), plant);
+        if (pos != trees.end())
+        {
+            *pos = trees.back();
+            trees.pop_back();
         }
+
+        plant_bucket.erase(it);
     }
+};
+
+static TreeIndex tree_index;
+
+static bool in_block(df::map_block *block, df::coord pos)
+{
+    return block->map_pos.x == (pos.x & ~15) &&
+           block->map_pos.y == (pos.y & ~15) &&
+           block->map_pos.z == pos.z;
+}
 
+static bool in_masks(const vector<df::block_burrow*> &masks, df::coord pos)
+{
+    for (auto mask : masks)
+        if (mask->getassignment(pos.x & 15, pos.y & 15))
+            return true;
     return false;
 }
 
@@ -295,48 +456,74 @@ static int do_chop_designation(bool chop, bool count_only, int *skipped = nullpt
     {
         *skipped = 0;
     }
-    for (size_t i = 0; i < world->plants.all.size(); i++)
-    {
-        const df::plant *plant = world->plants.all[i];
 
-        bool restricted = false;
-        if (skip_plant(plant, &restricted))
-        {
-            if (restricted && skipped)
-            {
-                ++*skipped;
-            }
-            continue;
-        }
+    tree_index.sync();
 
-        if (!count_only && !watchedBurrows.isValidPos(plant->pos))
-            continue;
+    vector<df::block_burrow*> masks;
+
+    for (auto &bucket : tree_index.buckets)
+    {
+        auto block = bucket.block;
+
+        bool block_in_burrows = count_only || watchedBurrows.getBlockMasks(block, &masks);
+        bool check_tiles = !count_only && !masks.empty();
 
-        if (chop && !Designations::isPlantMarked(plant))
+        for (size_t i = 0; i < bucket.trees.size(); i++)
         {
-            if (count_only)
+            const df::plant *plant = bucket.trees[i];
+
+            // A plant object reused at another position since the last sync
+            if (!in_block(block, plant->pos))
             {
-                if (Designations::canMarkPlant(plant))
-                    count++;
+                bool restricted = false;
+                if (skip_plant(plant, &restricted))
+                {
+                    if (restricted && skipped)
+                        ++*skipped;
+                    continue;
+                }
+                if (!count_only && !watchedBurrows.isValidPos(plant->pos))
+                    continue;
             }
             else
             {
-                if (Designations::markPlant(plant))
-                    count++;
+                bool restricted = false;
+                if (skip_plant(plant, block, &restricted))
+                {
+                    if (restricted && skipped)
+                        ++*skipped;
+                    continue;
+                }
+                if (!block_in_burrows || (check_tiles && !in_masks(masks, plant->pos)))
+                    continue;
             }
-        }
 
-        if (!chop && Designations::isPlantMarked(plant))
-        {
-            if (count_only)
+            if (chop && !Designations::isPlantMarked(plant))
             {
-                if (Designations::canUnmarkPlant(plant))
-                    count++;
+                if (count_only)
+                {
+                    if (Designations::canMarkPlant(plant))
+                        count++;
+                }
+                else
+                {
+                    if (Designations::markPlant(plant))
+                        count++;
+                }
             }
-            else
+
+            if (!chop && Designations::isPlantMarked(plant))
             {
-                if (Designations::unmarkPlant(plant))
-                    count++;
+                if (count_only)
+                {
+                    if (Designations::canUnmarkPlant(plant))
+                        count++;
+                }
+                else
+                {
+                    if (Designations::unmarkPlant(plant))
+                        count++;
+                }
             }
         }
     }
@@ -382,7 +569,9 @@ static bool is_valid_item(df::item *item)
 
 static int get_log_count()
 {
-    std::vector<df::item*> &items = world->items.other[items_other_id::IN_PLAY];
+    // DF keeps a list of just the logs, so there is no need to look at
+    // every item in play.
+    std::vector<df::item*> &items = world->items.other[items_other_id::WOOD];
 
     // Pre-compute a bitmask with the bad flags
     df::item_flags bad_flags;
@@ -916,8 +1105,14 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
 {
     switch (event) {
     case SC_MAP_LOADED:
+        tree_index.clear();
+        species_flags.clear();
         initialize();
         break;
+    case SC_MAP_UNLOADED:
+        tree_index.clear();
+        species_flags.clear();
+        break;
     default:
         break;
     }
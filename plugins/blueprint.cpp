@@ -3,6 +3,10 @@
 //Translates a region of tiles specified by the cursor and arguments/prompts into a series of blueprint files suitable for digfort/buildingplan/quickfort
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include <Console.h>
 #include <PluginManager.h>
@@ -73,7 +77,7 @@ pair<uint32_t, uint32_t> get_building_size(df::building* b)
     return pair<uint32_t, uint32_t>(b->x2 - b->x1 + 1, b->y2 - b->y1 + 1);
 }
 
-char get_tile_dig(MapExtras::MapCache mc, int32_t x, int32_t y, int32_t z)
+char get_tile_dig(MapExtras::MapCache &mc, int32_t x, int32_t y, int32_t z)
 {
     df::tiletype tt = mc.tiletypeAt(DFCoord(x, y, z));
     df::tiletype_shape ts = tileShape(tt);
@@ -557,32 +561,63 @@ string get_tile_query(df::building* b)
     return " ";
 }
 
-command_result do_transform(DFCoord start, DFCoord end, string name, uint32_t phases)
+// Phases in the order their buffers are kept in level_output
+static const uint32_t phase_order[] = { DIG, BUILD, PLACE, QUERY };
+static const char * const phase_names[] = { "dig", "build", "place", "query" };
+static const size_t num_phases = 4;
+
+static const unsigned MAX_TRANSFORM_THREADS = 16;
+
+// The CSV text of one z-level, one buffer per phase
+struct level_output
 {
-    ofstream dig, build, place, query;
-    if (phases & QUERY)
-    {
-        //query = ofstream((name + "-query.csv").c_str(), ofstream::trunc);
-        query.open(name+"-query.csv", ofstream::trunc);
-        query << "#query" << endl;
-    }
-    if (phases & PLACE)
+    string text[num_phases];
+};
+
+static void transform_level(MapExtras::MapCache &mc, DFCoord start, DFCoord end, int32_t z, uint32_t phases, level_output &out)
+{
+    string &dig = out.text[0], &build = out.text[1], &place = out.text[2], &query = out.text[3];
+    bool need_building = (phases & (BUILD | PLACE | QUERY)) != 0;
+
+    for (int32_t y = start.y; y < end.y; y++)
     {
-        //place = ofstream(name + "-place.csv", ofstream::trunc);
-        place.open(name+"-place.csv", ofstream::trunc);
-        place << "#place" << endl;
+        for (int32_t x = start.x; x < end.x; x++)
+        {
+            df::building* b = need_building ? DFHack::Buildings::findAtTile(DFCoord(x, y, z)) : NULL;
+            if (phases & QUERY)
+                query.append(get_tile_query(b)).push_back(',');
+            if (phases & PLACE)
+                place.append(get_tile_place(x, y, b)).push_back(',');
+            if (phases & BUILD)
+                build.append(get_tile_build(x, y, b)).push_back(',');
+            if (phases & DIG)
+            {
+                dig.push_back(get_tile_dig(mc, x, y, z));
+                dig.push_back(',');
+            }
+        }
+        for (size_t i = 0; i < num_phases; i++)
+            if (phases & phase_order[i])
+                out.text[i].append("#\n");
     }
-    if (phases & BUILD)
+    if (z < end.z - 1)
     {
-        //build = ofstream(name + "-build.csv", ofstream::trunc);
-        build.open(name+"-build.csv", ofstream::trunc);
-        build << "#build" << endl;
+        for (size_t i = 0; i < num_phases; i++)
+            if (phases & phase_order[i])
+                out.text[i].append("#<\n");
     }
-    if (phases & DIG)
+}
+
+command_result do_transform(DFCoord start, DFCoord end, string name, uint32_t phases)
+{
+    ofstream files[num_phases];
+    for (size_t i = 0; i < num_phases; i++)
     {
-        //dig = ofstream(name + "-dig.csv", ofstream::trunc);
-        dig.open(name+"-dig.csv", ofstream::trunc);
-        dig << "#dig" << endl;
+        if (phases & phase_order[i])
+        {
+            files[i].open(name + "-" + phase_names[i] + ".csv", ofstream::trunc);
+            files[i] << "#" << phase_names[i] << '\n';
+        }
     }
     if (start.x > end.x)
     {
@@ -603,52 +638,55 @@ command_result do_transform(DFCoord start, DFCoord end, string name, uint32_t ph
         end.z++;
     }
 
-    MapExtras::MapCache mc;
-    for (int32_t z = start.z; z < end.z; z++)
-    {
-        for (int32_t y = start.y; y < end.y; y++)
+    // Levels are rendered in parallel, each worker with its own MapCache,
+    // and written out in order as soon as each one is complete.
+    size_t num_levels = end.z > start.z ? end.z - start.z : 0;
+    vector<level_output> levels(num_levels);
+    vector<char> level_done(num_levels, 0);
+    std::mutex lock;
+    std::condition_variable done_cond;
+    std::atomic<size_t> next_level(0);
+
+    auto worker = [&]() {
+        MapExtras::MapCache mc;
+        for (size_t i; (i = next_level++) < num_levels; )
         {
-            for (int32_t x = start.x; x < end.x; x++)
+            level_output out;
+            transform_level(mc, start, end, start.z + i, phases, out);
             {
-                df::building* b = DFHack::Buildings::findAtTile(DFCoord(x, y, z));
-                if (phases & QUERY)
-                    query << get_tile_query(b) << ',';
-                if (phases & PLACE)
-                    place << get_tile_place(x, y, b) << ',';
-                if (phases & BUILD)
-                    build << get_tile_build(x, y, b) << ',';
-                if (phases & DIG)
-                    dig << get_tile_dig(mc, x, y, z) << ',';
+                std::lock_guard<std::mutex> guard(lock);
+                swap(levels[i], out);
+                level_done[i] = 1;
             }
-            if (phases & QUERY)
-                query << "#" << endl;
-            if (phases & PLACE)
-                place << "#" << endl;
-            if (phases & BUILD)
-                build << "#" << endl;
-            if (phases & DIG)
-                dig << "#" << endl;
+            done_cond.notify_all();
         }
-        if (z < end.z - 1)
+    };
+
+    size_t num_threads = std::max(1u, std::min(std::thread::hardware_concurrency(), MAX_TRANSFORM_THREADS));
+    num_threads = std::min(num_threads, std::max(num_levels, size_t(1)));
+    vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; i++)
+        threads.emplace_back(worker);
+
+    for (size_t z = 0; z < num_levels; z++)
+    {
+        level_output out;
         {
-            if (phases & QUERY)
-                query << "#<" << endl;
-            if (phases & PLACE)
-                place << "#<" << endl;
-            if (phases & BUILD)
-                build << "#<" << endl;
-            if (phases & DIG)
-                dig << "#<" << endl;
+            std::unique_lock<std::mutex> guard(lock);
+            done_cond.wait(guard, [&]() { return level_done[z] != 0; });
+            swap(levels[z], out);
         }
+        for (size_t i = 0; i < num_phases; i++)
+            if (phases & phase_order[i])
+                files[i] << out.text[i];
     }
-    if (phases & QUERY)
-        query.close();
-    if (phases & PLACE)
-        place.close();
-    if (phases & BUILD)
-        build.close();
-    if (phases & DIG)
-        dig.close();
+
+    for (auto &thread : threads)
+        thread.join();
+
+    for (size_t i = 0; i < num_phases; i++)
+        if (phases & phase_order[i])
+            files[i].close();
     return CR_OK;
 }
 
@@ -701,7 +739,7 @@ static int create(lua_State *L, uint32_t options) {
         luaL_argerror(L, 2, "invalid end position");
     string filename(lua_tostring(L, 3));
 
-    lua_pushboolean(L, do_transform(start, end, filename, options));
+    lua_pushboolean(L, do_transform(start, end, filename, options) == CR_OK);
     return 1;
 
 }
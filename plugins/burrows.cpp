@@ -467,80 +467,10 @@ static void copyUnits(df::burrow *target, df::burrow *source, bool enable)
 
 static void copyTiles(df::burrow *target, df::burrow *source, bool enable)
 {
-    CHECK_NULL_POINTER(target);
-    CHECK_NULL_POINTER(source);
-
-    if (source == target)
-    {
-        if (!enable)
-            Burrows::clearTiles(target);
-
-        return;
-    }
-
-    std::vector<df::map_block*> pvec;
-    Burrows::listBlocks(&pvec, source);
-
-    for (size_t i = 0; i < pvec.size(); i++)
-    {
-        auto block = pvec[i];
-        auto smask = Burrows::getBlockMask(source, block);
-        if (!smask)
-            continue;
-
-        auto tmask = Burrows::getBlockMask(target, block, enable);
-        if (!tmask)
-            continue;
-
-        if (enable)
-        {
-            for (int j = 0; j < 16; j++)
-                tmask->tile_bitmask[j] |= smask->tile_bitmask[j];
-        }
-        else
-        {
-            for (int j = 0; j < 16; j++)
-                tmask->tile_bitmask[j] &= ~smask->tile_bitmask[j];
-
-            if (!tmask->has_assignments())
-                Burrows::deleteBlockMask(target, block, tmask);
-        }
-    }
-}
-
-static void setTilesByDesignation(df::burrow *target, df::tile_designation d_mask,
-                                  df::tile_designation d_value, bool enable)
-{
-    CHECK_NULL_POINTER(target);
-
-    auto &blocks = world->map.map_blocks;
-
-    for (size_t i = 0; i < blocks.size(); i++)
-    {
-        auto block = blocks[i];
-        df::block_burrow *mask = NULL;
-
-        for (int x = 0; x < 16; x++)
-        {
-            for (int y = 0; y < 16; y++)
-            {
-                if ((block->designation[x][y].whole & d_mask.whole) != d_value.whole)
-                    continue;
-
-                if (!mask)
-                    mask = Burrows::getBlockMask(target, block, enable);
-                if (!mask)
-                    goto next_block;
-
-                mask->setassignment(x, y, enable);
-            }
-        }
-
-        if (mask && !enable && !mask->has_assignments())
-            Burrows::deleteBlockMask(target, block, mask);
-
-    next_block:;
-    }
+    if (enable)
+        Burrows::unionTiles(target, source);
+    else
+        Burrows::subtractTiles(target, source);
 }
 
 static bool setTilesByKeyword(df::burrow *target, std::string name, bool enable)
@@ -569,7 +499,7 @@ static bool setTilesByKeyword(df::burrow *target, std::string name, bool enable)
     else
         return false;
 
-    setTilesByDesignation(target, mask, value, enable);
+    Burrows::setTilesByDesignation(target, mask, value, enable);
     return true;
 }
 
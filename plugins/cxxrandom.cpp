@@ -6,6 +6,10 @@
 - rollDouble(min, max)
 - rollNormal(mean, std_deviation)
 - rollBool(chance_for_true)
+- GenerateFastEngine(kind, seed)         --kind: "mt19937_64", "xoshiro256**" or "philox4x32"
+- GenerateStream(engine, stream)         --Independent stream of the same seed (xoshiro256**/philox4x32 only)
+- rollIntBulk/rollDoubleBulk/rollNormalBulk/rollBoolBulk(engine, ..., count[, target])
+                                         --Fills a lua table (or DF vector) with count values in one call
 - resetIndexRolls(string, array_length)  --String identifies the instance of SimpleNumDistribution to reset
 - rollIndex(string, array_length)        --String identifies the instance of SimpleNumDistribution to use
                                          --(Shuffles a vector of indices, Next() increments through then reshuffles when end() is reached)
@@ -28,6 +32,7 @@ Updated: Dec. 21 2017
 #include "Error.h"
 #include "Core.h"
 #include "DataFuncs.h"
+#include "LuaTools.h"
 #include <Console.h>
 #include <Export.h>
 #include <PluginManager.h>
@@ -54,11 +59,297 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
 }
 
 
+static uint64_t time_seed( uint64_t seed )
+{
+    return seed != 0 ? seed : std::chrono::system_clock::now().time_since_epoch().count();
+}
+
+static uint64_t splitmix64( uint64_t &state )
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * xoshiro256** (Blackman & Vigna). Much smaller and faster than mt19937_64;
+ * Jump() advances the state by 2^128 steps, so streams made by jumping from
+ * the same seed never overlap.
+ */
+class Xoshiro256
+{
+private:
+    uint64_t s[4];
+    static uint64_t rotl( uint64_t x, int k ) { return (x << k) | (x >> (64 - k)); }
+public:
+    typedef uint64_t result_type;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    explicit Xoshiro256( uint64_t seed = 1 ) { Seed( seed ); }
+
+    void Seed( uint64_t seed )
+    {
+        for( auto &word : s )
+        {
+            word = splitmix64( seed );
+        }
+    }
+    result_type operator()()
+    {
+        const uint64_t result = rotl( s[1] * 5, 7 ) * 9;
+        const uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl( s[3], 45 );
+        return result;
+    }
+    void Fill( uint64_t* out, size_t count )
+    {
+        for( size_t i = 0; i < count; ++i )
+        {
+            out[i] = (*this)();
+        }
+    }
+    void Jump()
+    {
+        static const uint64_t JUMP[] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+        uint64_t t[4] = { 0, 0, 0, 0 };
+        for( auto jump : JUMP )
+        {
+            for( int b = 0; b < 64; ++b )
+            {
+                if( jump & (uint64_t(1) << b) )
+                {
+                    for( int i = 0; i < 4; ++i )
+                        t[i] ^= s[i];
+                }
+                (*this)();
+            }
+        }
+        std::copy( t, t + 4, s );
+    }
+};
+
+/*
+ * Philox4x32-10 (Salmon et al.). Counter based: output block n is a pure
+ * function of (key, stream, n), so any number of streams can be derived from
+ * one seed, and Fill() computes several blocks side by side in plain arrays
+ * that the compiler can vectorize.
+ */
+class Philox4x32
+{
+private:
+    static const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+    static const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+    static const size_t LANES = 8;
+
+    uint32_t key[2];
+    uint64_t stream;
+    uint64_t block;
+    uint64_t buffer[2];
+    unsigned buffer_pos;
+
+    static void Round( uint32_t &c0, uint32_t &c1, uint32_t &c2, uint32_t &c3, uint32_t k0, uint32_t k1 )
+    {
+        uint64_t p0 = uint64_t(M0) * c0;
+        uint64_t p1 = uint64_t(M1) * c2;
+        uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+        c1 = uint32_t(p1);
+        c3 = uint32_t(p0);
+        c0 = n0;
+        c2 = n2;
+    }
+    // Computes LANES consecutive blocks starting at block, two outputs each
+    void Blocks( uint64_t* out, size_t lanes )
+    {
+        uint32_t c0[LANES], c1[LANES], c2[LANES], c3[LANES];
+        for( size_t i = 0; i < lanes; ++i )
+        {
+            uint64_t n = block + i;
+            c0[i] = uint32_t(n);
+            c1[i] = uint32_t(n >> 32);
+            c2[i] = uint32_t(stream);
+            c3[i] = uint32_t(stream >> 32);
+        }
+        uint32_t k0 = key[0], k1 = key[1];
+        for( int r = 0; r < 10; ++r )
+        {
+            for( size_t i = 0; i < lanes; ++i )
+                Round( c0[i], c1[i], c2[i], c3[i], k0, k1 );
+            k0 += W0;
+            k1 += W1;
+        }
+        for( size_t i = 0; i < lanes; ++i )
+        {
+            out[2*i] = uint64_t(c0[i]) | (uint64_t(c1[i]) << 32);
+            out[2*i+1] = uint64_t(c2[i]) | (uint64_t(c3[i]) << 32);
+        }
+        block += lanes;
+    }
+public:
+    typedef uint64_t result_type;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    explicit Philox4x32( uint64_t seed = 1, uint64_t stream = 0 ) { Seed( seed, stream ); }
+
+    void Seed( uint64_t seed, uint64_t stream = 0 )
+    {
+        key[0] = uint32_t(seed);
+        key[1] = uint32_t(seed >> 32);
+        this->stream = stream;
+        block = 0;
+        buffer_pos = 2;
+    }
+    result_type operator()()
+    {
+        if( buffer_pos >= 2 )
+        {
+            Blocks( buffer, 1 );
+            buffer_pos = 0;
+        }
+        return buffer[buffer_pos++];
+    }
+    void Fill( uint64_t* out, size_t count )
+    {
+        while( count > 0 && buffer_pos < 2 )
+        {
+            *out++ = buffer[buffer_pos++];
+            --count;
+        }
+        for( ; count >= 2*LANES; count -= 2*LANES, out += 2*LANES )
+        {
+            Blocks( out, LANES );
+        }
+        while( count-- > 0 )
+        {
+            *out++ = (*this)();
+        }
+    }
+};
+
+enum EngineKind
+{
+    ENGINE_MT19937_64,
+    ENGINE_XOSHIRO256,
+    ENGINE_PHILOX4X32
+};
+
+// One engine slot, usable as a standard uniform random bit generator
+class Engine
+{
+private:
+    static const size_t BATCH = 256;
+    EngineKind m_kind = ENGINE_MT19937_64;
+    uint64_t m_seed = 0;
+    std::mt19937_64 m_mt;
+    Xoshiro256 m_xoshiro;
+    Philox4x32 m_philox;
+    // Output generated ahead by NextBatched() and not consumed yet
+    std::vector<uint64_t> m_batch;
+    size_t m_batch_pos = 0;
+
+    void FillRaw( uint64_t* out, size_t count )
+    {
+        switch( m_kind )
+        {
+        case ENGINE_XOSHIRO256: m_xoshiro.Fill( out, count ); break;
+        case ENGINE_PHILOX4X32: m_philox.Fill( out, count ); break;
+        default:
+            for( size_t i = 0; i < count; ++i )
+                out[i] = m_mt();
+            break;
+        }
+    }
+public:
+    typedef uint64_t result_type;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    Engine() {}
+    Engine( EngineKind kind, uint64_t seed ) : m_kind( kind ) { Seed( seed ); }
+
+    EngineKind Kind() const { return m_kind; }
+
+    void Seed( uint64_t seed )
+    {
+        m_seed = seed;
+        m_batch.clear();
+        m_batch_pos = 0;
+        switch( m_kind )
+        {
+        case ENGINE_MT19937_64: m_mt.seed( seed ); break;
+        case ENGINE_XOSHIRO256: m_xoshiro.Seed( seed ); break;
+        case ENGINE_PHILOX4X32: m_philox.Seed( seed ); break;
+        }
+    }
+    // Returns an engine with the same seed producing a non-overlapping sequence;
+    // stream n is n+1 jumps away from the parent, so no stream repeats it
+    Engine Stream( uint64_t stream ) const
+    {
+        Engine engine( m_kind, m_seed );
+        switch( m_kind )
+        {
+        case ENGINE_MT19937_64:
+            CHECK_INVALID_ARGUMENT( m_kind != ENGINE_MT19937_64 );
+            break;
+        case ENGINE_XOSHIRO256:
+            CHECK_INVALID_ARGUMENT( stream < 0xFFFF );
+            for( uint64_t i = 0; i <= stream; ++i )
+                engine.m_xoshiro.Jump();
+            break;
+        case ENGINE_PHILOX4X32:
+            CHECK_INVALID_ARGUMENT( stream < UINT64_MAX );
+            engine.m_philox.Seed( m_seed, stream + 1 );
+            break;
+        }
+        return engine;
+    }
+    result_type operator()()
+    {
+        if( m_batch_pos < m_batch.size() )
+            return m_batch[m_batch_pos++];
+        switch( m_kind )
+        {
+        case ENGINE_XOSHIRO256: return m_xoshiro();
+        case ENGINE_PHILOX4X32: return m_philox();
+        default: return m_mt();
+        }
+    }
+    // Same as operator(), but refills in blocks of BATCH; whatever a bulk
+    // roll leaves over is handed out by the next calls, so no output is lost
+    result_type NextBatched()
+    {
+        if( m_batch_pos == m_batch.size() )
+        {
+            m_batch.resize( BATCH );
+            FillRaw( m_batch.data(), BATCH );
+            m_batch_pos = 0;
+        }
+        return m_batch[m_batch_pos++];
+    }
+    void Fill( uint64_t* out, size_t count )
+    {
+        while( count > 0 && m_batch_pos < m_batch.size() )
+        {
+            *out++ = m_batch[m_batch_pos++];
+            --count;
+        }
+        FillRaw( out, count );
+    }
+};
+
 class EnginesKeeper
 {
 private:
     EnginesKeeper() {}
-    std::unordered_map<uint16_t, std::mt19937_64> m_engines;
+    std::unordered_map<uint16_t, Engine> m_engines;
     uint16_t counter = 0;
 public:
     static EnginesKeeper& Instance()
@@ -66,9 +357,15 @@ public:
         static EnginesKeeper instance;
         return instance;
     }
-    uint16_t NewEngine( uint64_t seed )
+    uint16_t NewEngine( uint64_t seed, EngineKind kind = ENGINE_MT19937_64 )
+    {
+        m_engines[++counter] = Engine( kind, time_seed( seed ) );
+        return counter;
+    }
+    uint16_t NewStream( uint16_t id, uint64_t stream )
     {
-        std::mt19937_64 engine( seed != 0 ? seed : std::chrono::system_clock::now().time_since_epoch().count() );
+        CHECK_INVALID_ARGUMENT( m_engines.find( id ) != m_engines.end() );
+        Engine engine = m_engines[id].Stream( stream );
         m_engines[++counter] = engine;
         return counter;
     }
@@ -79,21 +376,55 @@ public:
     void NewSeed( uint16_t id, uint64_t seed )
     {
         CHECK_INVALID_ARGUMENT( m_engines.find( id ) != m_engines.end() );
-        m_engines[id].seed( seed != 0 ? seed : std::chrono::system_clock::now().time_since_epoch().count() );
+        m_engines[id].Seed( time_seed( seed ) );
     }
-    std::mt19937_64& RNG( uint16_t id )
+    Engine& RNG( uint16_t id )
     {
         CHECK_INVALID_ARGUMENT( m_engines.find( id ) != m_engines.end() );
         return m_engines[id];
     }
 };
 
+/*
+ * Feeds distributions from blocks of engine output generated in one batch,
+ * instead of one engine call per number.
+ */
+class BatchBits
+{
+private:
+    Engine &m_engine;
+public:
+    typedef uint64_t result_type;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    explicit BatchBits( Engine &engine ) : m_engine( engine ) {}
+
+    result_type operator()() { return m_engine.NextBatched(); }
+};
+
 
 uint16_t GenerateEngine( uint64_t seed )
 {
     return EnginesKeeper::Instance().NewEngine( seed );
 }
 
+uint16_t GenerateFastEngine( std::string kind, uint64_t seed )
+{
+    if( kind == "mt19937_64" )
+        return EnginesKeeper::Instance().NewEngine( seed, ENGINE_MT19937_64 );
+    if( kind == "xoshiro256**" || kind == "xoshiro" )
+        return EnginesKeeper::Instance().NewEngine( seed, ENGINE_XOSHIRO256 );
+    if( kind == "philox4x32" || kind == "philox" )
+        return EnginesKeeper::Instance().NewEngine( seed, ENGINE_PHILOX4X32 );
+    throw Error::InvalidArgument( "kind", DFHACK_FUNCTION_SIG );
+}
+
+uint16_t GenerateStream( uint16_t id, uint64_t stream )
+{
+    return EnginesKeeper::Instance().NewStream( id, stream );
+}
+
 void DestroyEngine( uint16_t id )
 {
     EnginesKeeper::Instance().DestroyEngine( id );
@@ -130,6 +461,92 @@ bool     rollBool(uint16_t id, float p)
 }
 
 
+/*
+ * Bulk generation: rollXBulk(engine, <distribution args>, count[, target])
+ * returns a table with count values. If target is a table it is refilled
+ * (and trimmed) in place; if it is a DF vector it is resized and filled.
+ */
+template<class Next>
+static int fill_target( lua_State *L, int target, lua_Integer count, Next next )
+{
+    if( lua_isnoneornil( L, target ) )
+    {
+        lua_createtable( L, int(count), 0 );
+        for( lua_Integer i = 0; i < count; ++i )
+        {
+            next();
+            lua_rawseti( L, -2, i + 1 );
+        }
+        return 1;
+    }
+
+    lua_settop( L, target );
+    if( lua_istable( L, target ) )
+    {
+        for( lua_Integer i = 0; i < count; ++i )
+        {
+            next();
+            lua_rawseti( L, target, i + 1 );
+        }
+        for( lua_Integer i = count + 1; lua_rawgeti( L, target, i ) != LUA_TNIL; ++i )
+        {
+            lua_pop( L, 1 );
+            lua_pushnil( L );
+            lua_rawseti( L, target, i );
+        }
+        lua_pop( L, 1 );
+        return 1;
+    }
+
+    luaL_argcheck( L, Lua::IsDFObject( L, target ) == Lua::OBJ_REF, target, "table or DF vector expected" );
+    lua_getfield( L, target, "resize" );
+    lua_pushvalue( L, target );
+    lua_pushinteger( L, count );
+    lua_call( L, 2, 0 );
+    for( lua_Integer i = 0; i < count; ++i )
+    {
+        next();
+        lua_seti( L, target, i );
+    }
+    return 1;
+}
+
+static lua_Integer check_count( lua_State *L, int arg )
+{
+    lua_Integer count = luaL_checkinteger( L, arg );
+    luaL_argcheck( L, count >= 0, arg, "count must not be negative" );
+    return count;
+}
+
+static int rollIntBulk( lua_State *L )
+{
+    BatchBits bits( EnginesKeeper::Instance().RNG( luaL_checkinteger( L, 1 ) ) );
+    std::uniform_int_distribution<lua_Integer> ND( luaL_checkinteger( L, 2 ), luaL_checkinteger( L, 3 ) );
+    return fill_target( L, 5, check_count( L, 4 ), [&]() { lua_pushinteger( L, ND( bits ) ); } );
+}
+
+static int rollDoubleBulk( lua_State *L )
+{
+    BatchBits bits( EnginesKeeper::Instance().RNG( luaL_checkinteger( L, 1 ) ) );
+    std::uniform_real_distribution<double> ND( luaL_checknumber( L, 2 ), luaL_checknumber( L, 3 ) );
+    return fill_target( L, 5, check_count( L, 4 ), [&]() { lua_pushnumber( L, ND( bits ) ); } );
+}
+
+static int rollNormalBulk( lua_State *L )
+{
+    BatchBits bits( EnginesKeeper::Instance().RNG( luaL_checkinteger( L, 1 ) ) );
+    std::normal_distribution<double> ND( luaL_checknumber( L, 2 ), luaL_checknumber( L, 3 ) );
+    return fill_target( L, 5, check_count( L, 4 ), [&]() { lua_pushnumber( L, ND( bits ) ); } );
+}
+
+static int rollBoolBulk( lua_State *L )
+{
+    BatchBits bits( EnginesKeeper::Instance().RNG( luaL_checkinteger( L, 1 ) ) );
+    std::bernoulli_distribution ND( luaL_checknumber( L, 2 ) );
+    return fill_target( L, 4, check_count( L, 3 ), [&]() { lua_pushboolean( L, ND( bits ) ); } );
+}
+
+
 class NumberSequence
 {
 private:
@@ -258,6 +675,8 @@ void DebugSequence( uint16_t id )
 
 DFHACK_PLUGIN_LUA_FUNCTIONS {
     DFHACK_LUA_FUNCTION(GenerateEngine),
+    DFHACK_LUA_FUNCTION(GenerateFastEngine),
+    DFHACK_LUA_FUNCTION(GenerateStream),
     DFHACK_LUA_FUNCTION(DestroyEngine),
     DFHACK_LUA_FUNCTION(NewSeed),
     DFHACK_LUA_FUNCTION(rollInt),
@@ -272,3 +691,11 @@ DFHACK_PLUGIN_LUA_FUNCTIONS {
     DFHACK_LUA_FUNCTION(DebugSequence),
     DFHACK_LUA_END
 };
+
+DFHACK_PLUGIN_LUA_COMMANDS {
+    DFHACK_LUA_COMMAND(rollIntBulk),
+    DFHACK_LUA_COMMAND(rollDoubleBulk),
+    DFHACK_LUA_COMMAND(rollNormalBulk),
+    DFHACK_LUA_COMMAND(rollBoolBulk),
+    DFHACK_LUA_END
+};
@@ -8,6 +8,10 @@
 #include "df/enabler.h"
 #include "df/renderer.h"
 
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <memory>
 #include <vector>
 #include <string>
 #include "PassiveSocket.h"
@@ -23,16 +27,95 @@ DFHACK_PLUGIN("dfstream");
 REQUIRE_GLOBAL(gps);
 REQUIRE_GLOBAL(enabler);
 
-// Owns the thread that accepts TCP connections and forwards messages to clients;
-// has a mutex
+// An encoded frame: one or more length-prefixed rectangle messages of the form
+// "dimx dimy x y w h\n" followed by w*h (char, color) pairs.
+struct encoded_frame {
+    std::string data;
+    bool keyframe;
+};
+
+// Bounded single-producer (render thread), single-consumer (sender thread)
+// queue of frames. Never blocks; push fails when the sender is behind.
+class frame_queue {
+    static const size_t capacity = 16;
+
+    encoded_frame * slots[capacity];
+    std::atomic<size_t> head; // next slot to pop, written by the consumer
+    std::atomic<size_t> tail; // next slot to push, written by the producer
+
+public:
+    frame_queue()
+        : head(0)
+        , tail(0)
+    {
+    }
+
+    ~frame_queue() {
+        while (encoded_frame * frame = pop())
+            delete frame;
+    }
+
+    bool full() const {
+        return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) >= capacity;
+    }
+
+    // producer only; takes ownership of frame on success
+    bool push(encoded_frame * frame) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) >= capacity)
+            return false;
+        slots[t % capacity] = frame;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only; returns NULL if empty
+    encoded_frame * pop() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return NULL;
+        encoded_frame * frame = slots[h % capacity];
+        head.store(h + 1, std::memory_order_release);
+        return frame;
+    }
+};
+
+// Owns the thread that accepts TCP connections and the thread that forwards
+// queued frames to clients. Only the sender thread touches connected sockets,
+// so a slow client never stalls rendering: each client has its own backlog,
+// and a client whose backlog grows too large is dropped back to waiting for
+// the next keyframe.
 class client_pool {
     typedef tthread::mutex mutex;
+    typedef std::shared_ptr<const encoded_frame> frame_ptr;
+
+    // maximum number of unsent bytes per client before frames are dropped
+    static const size_t max_backlog = 1 << 20;
 
+    struct client {
+        CActiveSocket * sock;
+        std::deque<frame_ptr> backlog;
+        size_t backlog_bytes;
+        size_t offset; // bytes of backlog.front() already sent
+        bool needs_keyframe;
+    };
+
+    // accepted sockets not yet adopted by the sender thread
     mutex clients_lock;
-    std::vector<CActiveSocket *> clients;
+    std::vector<CActiveSocket *> new_clients;
+
+    // owned by the sender thread
+    std::vector<client> clients;
+
+    std::atomic<size_t> client_count;
+    std::atomic<bool> keyframe_requested;
+    std::atomic<bool> stopping;
+
+    frame_queue queue;
 
     // TODO - delete this at some point
     tthread::thread * accepter;
+    tthread::thread * sender;
 
     static void accept_clients(void * client_pool_pointer) {
         client_pool * p = reinterpret_cast<client_pool *>(client_pool_pointer);
@@ -47,44 +130,144 @@ class client_pool {
         while (true) {
             CActiveSocket * client = socket.Accept();
             if (client != 0) {
-                lock l(*p);
-                p->clients.push_back(client);
+                p->add_client(client);
             }
         }
     }
 
-public:
-    class lock {
-        tthread::lock_guard<mutex> l;
-    public:
-        lock(client_pool & p)
-            : l(p.clients_lock)
-        {
+    static void send_frames(void * client_pool_pointer) {
+        client_pool * p = reinterpret_cast<client_pool *>(client_pool_pointer);
+        while (!p->stopping.load()) {
+            p->adopt_clients();
+
+            bool got_frames = false;
+            while (encoded_frame * raw = p->queue.pop()) {
+                got_frames = true;
+                p->enqueue(frame_ptr(raw));
+            }
+
+            bool blocked = false;
+            for (size_t i = 0; i < p->clients.size(); ) {
+                if (!p->flush(p->clients[i])) {
+                    delete p->clients[i].sock;
+                    p->clients.erase(p->clients.begin() + i);
+                    p->client_count.fetch_sub(1);
+                    continue;
+                }
+                blocked = blocked || !p->clients[i].backlog.empty();
+                ++i;
+            }
+
+            if (!got_frames || blocked)
+                tthread::this_thread::sleep_for(tthread::chrono::milliseconds(5));
         }
-    };
-    friend class client_pool::lock;
+    }
+
+    void adopt_clients() {
+        tthread::lock_guard<mutex> l(clients_lock);
+        for (size_t i = 0; i < new_clients.size(); ++i) {
+            new_clients[i]->SetNonblocking();
+            client c;
+            c.sock = new_clients[i];
+            c.backlog_bytes = 0;
+            c.offset = 0;
+            c.needs_keyframe = true;
+            clients.push_back(c);
+            keyframe_requested.store(true);
+        }
+        new_clients.clear();
+    }
+
+    void enqueue(const frame_ptr & frame) {
+        for (size_t i = 0; i < clients.size(); ++i) {
+            client & c = clients[i];
+            if (frame->keyframe) {
+                c.needs_keyframe = false;
+            } else if (c.needs_keyframe) {
+                continue;
+            }
+
+            if (c.backlog_bytes + frame->data.size() > max_backlog) {
+                // Keep only the partially sent frame, so the stream stays
+                // well-formed, and resynchronize on the next keyframe.
+                while (c.backlog.size() > (c.offset > 0 ? 1u : 0u)) {
+                    c.backlog_bytes -= c.backlog.back()->data.size();
+                    c.backlog.pop_back();
+                }
+                c.needs_keyframe = true;
+                keyframe_requested.store(true);
+                continue;
+            }
+
+            c.backlog.push_back(frame);
+            c.backlog_bytes += frame->data.size();
+        }
+    }
+
+    // returns false if the client has disconnected
+    bool flush(client & c) {
+        while (!c.backlog.empty()) {
+            const std::string & data = c.backlog.front()->data;
+            int32_t sent = c.sock->Send((const uint8_t *) data.data() + c.offset, data.size() - c.offset);
+            if (sent < 0) {
+                return c.sock->GetSocketError() == CSimpleSocket::SocketEwouldblock;
+            }
+            c.offset += sent;
+            if (c.offset < data.size()) {
+                return true;
+            }
+            c.backlog_bytes -= data.size();
+            c.backlog.pop_front();
+            c.offset = 0;
+        }
+        return true;
+    }
 
-    client_pool() {
+public:
+    client_pool()
+        : client_count(0)
+        , keyframe_requested(false)
+        , stopping(false)
+    {
         accepter = new tthread::thread(accept_clients, this);
+        sender = new tthread::thread(send_frames, this);
+    }
+
+    ~client_pool() {
+        stopping.store(true);
+        sender->join();
+        delete sender;
+        for (size_t i = 0; i < clients.size(); ++i)
+            delete clients[i].sock;
     }
 
-    // MUST have lock
     bool has_clients() {
-        return !clients.empty();
+        return client_count.load() > 0;
     }
 
-    // MUST have lock
     void add_client(CActiveSocket * sock) {
-        clients.push_back(sock);
+        tthread::lock_guard<mutex> l(clients_lock);
+        new_clients.push_back(sock);
+        client_count.fetch_add(1);
     }
 
-    // MUST have lock
-    void broadcast(const std::string & message) {
-        unsigned int sz = htonl(message.size());
-        for (size_t i = 0; i < clients.size(); ++i) {
-            clients[i]->Send(reinterpret_cast<const uint8_t *>(&sz), sizeof(sz));
-            clients[i]->Send((const uint8_t *) message.c_str(), message.size());
-        }
+    // true if the sender cannot take another frame right now
+    bool backed_up() const {
+        return queue.full();
+    }
+
+    // clears and returns whether a client is waiting for a keyframe
+    bool take_keyframe_request() {
+        return keyframe_requested.exchange(false);
+    }
+
+    // Hands a frame to the sender thread; never blocks. Returns false (and
+    // deletes the frame) if the queue is full.
+    bool broadcast(encoded_frame * frame) {
+        if (queue.push(frame))
+            return true;
+        delete frame;
+        return false;
     }
 };
 
@@ -94,8 +277,23 @@ class renderer_decorator : public df::renderer {
     // the renderer we're decorating
     df::renderer * inner;
 
-    // how many frames have passed since we last sent a frame
-    int framesNotPrinted;
+    // how many delta frames have been sent since the last keyframe
+    int framesSinceKeyframe;
+
+    // send a full frame at least this often, in frames
+    static const int keyframe_interval = 256;
+
+    // runs of changed cells closer than this are sent as one run, since each
+    // run costs a message header of about this many cells
+    static const int merge_gap = 8;
+
+    // screen contents as of the last frame handed to the sender
+    // (char | color << 8, row-major)
+    std::vector<uint16_t> sent;
+    int sent_dimx, sent_dimy;
+
+    // scratch buffer for the current screen contents
+    std::vector<uint16_t> current;
 
     // set to false in the destructor
     bool * alive;
@@ -149,10 +347,49 @@ class renderer_decorator : public df::renderer {
         inner->screentexpos_cbr_old = screentexpos_cbr_old;
     }
 
+    // Converts gps->screen (column-major, 4 bytes per cell) into current
+    void capture_screen(int dimx, int dimy) {
+        static const unsigned char translate[] =
+        { 0, 4, 2, 6, 1, 5, 3, 7, 8, 12, 10, 14, 9, 13, 11, 15 };
+        current.resize(dimx * dimy);
+        unsigned char * sc_ = gps->screen;
+        for (int y = 0; y < dimy; ++y) {
+            unsigned char * sc = sc_;
+            uint16_t * out = &current[y * dimx];
+            for (int x = 0; x < dimx; ++x) {
+                unsigned char ch   = sc[0];
+                unsigned char bold = (sc[3] != 0) * 8;
+                unsigned char fg   = translate[(sc[1] + bold) % 16];
+                unsigned char bg   = translate[sc[2] % 16]*16;
+                out[x] = ch | uint16_t(fg+bg) << 8;
+                sc += 4*dimy;
+            }
+            sc_ += 4;
+        }
+    }
+
+    // Appends one length-prefixed rectangle message taken from current
+    void append_rect(std::string & out, int dimx, int dimy, int x0, int y0, int w, int h) {
+        char header[64];
+        int header_len = snprintf(header, sizeof(header), "%d %d %d %d %d %d\n", dimx, dimy, x0, y0, w, h);
+        uint32_t sz = htonl(header_len + 2 * w * h);
+        out.append(reinterpret_cast<const char *>(&sz), sizeof(sz));
+        out.append(header, header_len);
+        for (int y = y0; y < y0 + h; ++y) {
+            const uint16_t * row = &current[y * dimx];
+            for (int x = x0; x < x0 + w; ++x) {
+                out.push_back(char(row[x] & 0xff));
+                out.push_back(char(row[x] >> 8));
+            }
+        }
+    }
+
 public:
     renderer_decorator(df::renderer * inner, bool * alive)
         : inner(inner)
-        , framesNotPrinted(0)
+        , framesSinceKeyframe(0)
+        , sent_dimx(0)
+        , sent_dimy(0)
         , alive(alive)
     {
         copy_from_inner();
@@ -169,35 +406,56 @@ public:
         copy_to_inner();
         inner->render();
 
-        ++framesNotPrinted;
-        int gfps = enabler->calculated_gfps;
-        if (gfps == 0) gfps = 1;
-        // send a frame roughly every 128 mibiseconds (1 second = 1024 mibiseconds)
-        if ((framesNotPrinted * 1024) / gfps <= 128) return;
-
-        client_pool::lock lock(clients);
         if (!clients.has_clients()) return;
-        framesNotPrinted = 0;
-        std::stringstream frame;
-        frame << gps->dimx << ' ' << gps->dimy << " 0 0 " << gps->dimx << ' ' << gps->dimy << '\n';
-        unsigned char * sc_ = gps->screen;
-        for (int y = 0; y < gps->dimy; ++y) {
-            unsigned char * sc = sc_;
-            for (int x = 0; x < gps->dimx; ++x) {
-                unsigned char ch   = sc[0];
-                unsigned char bold = (sc[3] != 0) * 8;
-                unsigned char translate[] =
-                { 0, 4, 2, 6, 1, 5, 3, 7, 8, 12, 10, 14, 9, 13, 11, 15 };
-                unsigned char fg   = translate[(sc[1] + bold) % 16];
-                unsigned char bg   = translate[sc[2] % 16]*16;
-                frame.put(ch);
-                frame.put(fg+bg);
-                sc += 4*gps->dimy;
+        // If the sender is behind, skip this frame; the next one is still
+        // diffed against what the clients will have seen.
+        if (clients.backed_up()) return;
+
+        int dimx = gps->dimx, dimy = gps->dimy;
+        capture_screen(dimx, dimy);
+
+        bool keyframe = clients.take_keyframe_request()
+            || framesSinceKeyframe >= keyframe_interval
+            || dimx != sent_dimx || dimy != sent_dimy;
+
+        encoded_frame * frame = new encoded_frame;
+        frame->keyframe = keyframe;
+        if (keyframe) {
+            append_rect(frame->data, dimx, dimy, 0, 0, dimx, dimy);
+        } else {
+            for (int y = 0; y < dimy; ++y) {
+                const uint16_t * cur = &current[y * dimx];
+                const uint16_t * old = &sent[y * dimx];
+                int x = 0;
+                while (x < dimx) {
+                    if (cur[x] == old[x]) { ++x; continue; }
+                    int start = x, end = x + 1, gap = 0;
+                    for (x = end; x < dimx && gap < merge_gap; ++x) {
+                        if (cur[x] != old[x]) {
+                            end = x + 1;
+                            gap = 0;
+                        } else {
+                            ++gap;
+                        }
+                    }
+                    append_rect(frame->data, dimx, dimy, start, y, end - start, 1);
+                    x = end;
+                }
+            }
+            if (frame->data.empty()) {
+                delete frame;
+                return;
             }
-            sc_ += 4;
         }
-        clients.broadcast(frame.str());
+
+        // the frame is only lost if the queue filled up since backed_up()
+        if (!clients.broadcast(frame)) return;
+        sent.swap(current);
+        sent_dimx = dimx;
+        sent_dimy = dimy;
+        framesSinceKeyframe = keyframe ? 0 : framesSinceKeyframe + 1;
     }
+
     virtual void set_fullscreen() { inner->set_fullscreen(); }
     virtual void zoom(df::zoom_commands cmd) {
         copy_to_inner();
@@ -1,7 +1,6 @@
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
-#include <stack>
 #include <string>
 #include <cmath>
 
@@ -11,6 +10,7 @@
 #include "PluginManager.h"
 #include "uicommon.h"
 
+#include "modules/FloodFill.h"
 #include "modules/Gui.h"
 #include "modules/MapCache.h"
 #include "modules/Maps.h"
@@ -20,7 +20,6 @@
 
 using std::vector;
 using std::string;
-using std::stack;
 using namespace DFHack;
 using namespace df::enums;
 
@@ -1080,127 +1079,66 @@ command_result digv (color_ostream &out, vector <string> & parameters)
         con.printerr("I won't dig the borders. That would be cheating!\n");
         return CR_FAILURE;
     }
-    MapExtras::MapCache * MCache = new MapExtras::MapCache;
-    df::tile_designation des = MCache->designationAt(xy);
-    df::tiletype tt = MCache->tiletypeAt(xy);
-    int16_t veinmat = MCache->veinMaterialAt(xy);
+    MapExtras::MapCache MCache;
+    df::tile_designation des = MCache.designationAt(xy);
+    df::tiletype tt = MCache.tiletypeAt(xy);
+    int16_t veinmat = MCache.veinMaterialAt(xy);
     if( veinmat == -1 )
     {
         con.printerr("This tile is not a vein.\n");
-        delete MCache;
         return CR_FAILURE;
     }
     con.print("%d/%d/%d tiletype: %d, veinmat: %d, designation: 0x%x ... DIGGING!\n", cx,cy,cz, tt, veinmat, des.whole);
-    stack <DFHack::DFCoord> flood;
-    flood.push(xy);
-
-    while( !flood.empty() )
-    {
-        DFHack::DFCoord current = flood.top();
-        flood.pop();
-        if (MCache->tagAt(current))
-            continue;
-        int16_t vmat2 = MCache->veinMaterialAt(current);
-        tt = MCache->tiletypeAt(current);
-        if(!DFHack::isWallTerrain(tt))
-            continue;
-        if(vmat2!=veinmat)
-            continue;
 
+    FloodFill::Engine filler(
+        [&](DFHack::DFCoord pos) {
+            return MCache.testCoord(pos)
+                && DFHack::isWallTerrain(MCache.tiletypeAt(pos))
+                && MCache.veinMaterialAt(pos) == veinmat;
+        },
+        FloodFill::DIAGONAL | (updown ? FloodFill::VERTICAL : 0)
+    );
+    filler.setBounds(DFHack::DFCoord(1, 1, 0), DFHack::DFCoord(tx_max - 2, ty_max - 2, z_max - 1));
+
+    filler.fill(xy, [&](DFHack::DFCoord current) {
         // found a good tile, dig+unset material
-        df::tile_designation des = MCache->designationAt(current);
-        df::tile_designation des_minus;
-        df::tile_designation des_plus;
-        des_plus.whole = des_minus.whole = 0;
-        int16_t vmat_minus = -1;
-        int16_t vmat_plus = -1;
-        bool below = 0;
-        bool above = 0;
+        df::tile_designation des = MCache.designationAt(current);
         if(updown)
         {
-            if(MCache->testCoord(current-1))
+            if(current.z > 0 && MCache.testCoord(current-1)
+                && MCache.veinMaterialAt(current-1) == veinmat)
             {
-                below = 1;
-                des_minus = MCache->designationAt(current-1);
-                vmat_minus = MCache->veinMaterialAt(current-1);
+                df::tile_designation des_minus = MCache.designationAt(current-1);
+                if(des_minus.bits.dig == tile_dig_designation::DownStair)
+                    des_minus.bits.dig = tile_dig_designation::UpDownStair;
+                else
+                    des_minus.bits.dig = tile_dig_designation::UpStair;
+                MCache.setDesignationAt(current-1,des_minus,priority);
+
+                des.bits.dig = tile_dig_designation::DownStair;
             }
-
-            if(MCache->testCoord(current+1))
+            if(current.z < int32_t(z_max) - 1 && MCache.testCoord(current+1)
+                && MCache.veinMaterialAt(current+1) == veinmat)
             {
-                above = 1;
-                des_plus = MCache->designationAt(current+1);
-                vmat_plus = MCache->veinMaterialAt(current+1);
+                df::tile_designation des_plus = MCache.designationAt(current+1);
+                if(des_plus.bits.dig == tile_dig_designation::UpStair)
+                    des_plus.bits.dig = tile_dig_designation::UpDownStair;
+                else
+                    des_plus.bits.dig = tile_dig_designation::DownStair;
+                MCache.setDesignationAt(current+1,des_plus,priority);
+
+                if(des.bits.dig == tile_dig_designation::DownStair)
+                    des.bits.dig = tile_dig_designation::UpDownStair;
+                else
+                    des.bits.dig = tile_dig_designation::UpStair;
             }
         }
-        if(MCache->testCoord(current))
-        {
-            MCache->setTagAt(current, 1);
-
-            if(current.x < int32_t(tx_max) - 2)
-            {
-                flood.push(DFHack::DFCoord(current.x + 1, current.y, current.z));
-                if(current.y < int32_t(ty_max) - 2)
-                {
-                    flood.push(DFHack::DFCoord(current.x + 1, current.y + 1,current.z));
-                    flood.push(DFHack::DFCoord(current.x, current.y + 1,current.z));
-                }
-                if(current.y > 1)
-                {
-                    flood.push(DFHack::DFCoord(current.x + 1, current.y - 1,current.z));
-                    flood.push(DFHack::DFCoord(current.x, current.y - 1,current.z));
-                }
-            }
-            if(current.x > 1)
-            {
-                flood.push(DFHack::DFCoord(current.x - 1, current.y,current.z));
-                if(current.y < int32_t(ty_max) - 2)
-                {
-                    flood.push(DFHack::DFCoord(current.x - 1, current.y + 1,current.z));
-                    flood.push(DFHack::DFCoord(current.x, current.y + 1,current.z));
-                }
-                if(current.y > 1)
-                {
-                    flood.push(DFHack::DFCoord(current.x - 1, current.y - 1,current.z));
-                    flood.push(DFHack::DFCoord(current.x, current.y - 1,current.z));
-                }
-            }
-            if(updown)
-            {
-                if(current.z > 0 && below && vmat_minus == vmat2)
-                {
-                    flood.push(current-1);
-
-                    if(des_minus.bits.dig == tile_dig_designation::DownStair)
-                        des_minus.bits.dig = tile_dig_designation::UpDownStair;
-                    else
-                        des_minus.bits.dig = tile_dig_designation::UpStair;
-                    MCache->setDesignationAt(current-1,des_minus,priority);
+        if(des.bits.dig == tile_dig_designation::No)
+            des.bits.dig = tile_dig_designation::Default;
+        MCache.setDesignationAt(current,des,priority);
+    });
 
-                    des.bits.dig = tile_dig_designation::DownStair;
-                }
-                if(current.z < int32_t(z_max) - 1 && above && vmat_plus == vmat2)
-                {
-                    flood.push(current+ 1);
-
-                    if(des_plus.bits.dig == tile_dig_designation::UpStair)
-                        des_plus.bits.dig = tile_dig_designation::UpDownStair;
-                    else
-                        des_plus.bits.dig = tile_dig_designation::DownStair;
-                    MCache->setDesignationAt(current+1,des_plus,priority);
-
-                    if(des.bits.dig == tile_dig_designation::DownStair)
-                        des.bits.dig = tile_dig_designation::UpDownStair;
-                    else
-                        des.bits.dig = tile_dig_designation::UpStair;
-                }
-            }
-            if(des.bits.dig == tile_dig_designation::No)
-                des.bits.dig = tile_dig_designation::Default;
-            MCache->setDesignationAt(current,des,priority);
-        }
-    }
-    MCache->WriteAll();
-    delete MCache;
+    MCache.WriteAll();
     return CR_OK;
 }
 
@@ -1213,12 +1151,13 @@ command_result diglx (color_ostream &out, vector <string> & parameters)
     return digl(out,lol);
 }
 
-// TODO:
-// digl and digv share the longish floodfill code and only use different conditions
-// to check if a tile should be marked for digging or not.
-// to make the plugin a bit smaller and cleaner a main execute method would be nice
-// (doing the floodfill stuff and do the checks dependin on whether called in
-// "vein" or "layer" mode)
+static bool is_layer_stone(df::tiletype tt)
+{
+    // don't dig out LAVA_STONE or MAGMA (semi-molten rock) accidentally
+    return tileMaterial(tt) == tiletype_material::STONE
+        || tileMaterial(tt) == tiletype_material::SOIL;
+}
+
 command_result digl (color_ostream &out, vector <string> & parameters)
 {
     // HOTKEY COMMAND: CORE ALREADY SUSPENDED
@@ -1267,157 +1206,80 @@ command_result digl (color_ostream &out, vector <string> & parameters)
         con.printerr("I won't dig the borders. That would be cheating!\n");
         return CR_FAILURE;
     }
-    MapExtras::MapCache * MCache = new MapExtras::MapCache;
-    df::tile_designation des = MCache->designationAt(xy);
-    df::tiletype tt = MCache->tiletypeAt(xy);
-    int16_t veinmat = MCache->veinMaterialAt(xy);
-    int16_t basemat = MCache->layerMaterialAt(xy);
+    MapExtras::MapCache MCache;
+    df::tile_designation des = MCache.designationAt(xy);
+    df::tiletype tt = MCache.tiletypeAt(xy);
+    int16_t veinmat = MCache.veinMaterialAt(xy);
+    int16_t basemat = MCache.layerMaterialAt(xy);
     if( veinmat != -1 )
     {
         con.printerr("This is a vein. Use vdig instead!\n");
-        delete MCache;
         return CR_FAILURE;
     }
     con.print("%d/%d/%d tiletype: %d, basemat: %d, designation: 0x%x ... DIGGING!\n", cx,cy,cz, tt, basemat, des.whole);
-    stack <DFHack::DFCoord> flood;
-    flood.push(xy);
-
-    int i = 0;
-    while( !flood.empty() )
-    {
-        DFHack::DFCoord current = flood.top();
-        flood.pop();
-        if (MCache->tagAt(current))
-            continue;
-        int16_t vmat2 = MCache->veinMaterialAt(current);
-        int16_t bmat2 = MCache->layerMaterialAt(current);
-        tt = MCache->tiletypeAt(current);
-
-        if(!DFHack::isWallTerrain(tt))
-            continue;
-        if(vmat2!=-1)
-            continue;
-        if(bmat2!=basemat)
-            continue;
-
-        // don't dig out LAVA_STONE or MAGMA (semi-molten rock) accidentally
-        if(    tileMaterial(tt)!=tiletype_material::STONE
-            && tileMaterial(tt)!=tiletype_material::SOIL)
-            continue;
 
+    // tiles of the same layer that may be connected with stairs
+    auto same_layer = [&](DFHack::DFCoord pos) {
+        return MCache.testCoord(pos)
+            && is_layer_stone(MCache.tiletypeAt(pos))
+            && MCache.veinMaterialAt(pos) == -1
+            && MCache.layerMaterialAt(pos) == basemat;
+    };
+
+    FloodFill::Engine filler(
+        [&](DFHack::DFCoord pos) {
+            return same_layer(pos) && DFHack::isWallTerrain(MCache.tiletypeAt(pos));
+        },
+        FloodFill::DIAGONAL | (updown ? FloodFill::VERTICAL : 0)
+    );
+    filler.setBounds(DFHack::DFCoord(1, 1, 0), DFHack::DFCoord(tx_max - 2, ty_max - 2, z_max - 1));
+
+    filler.fill(xy, [&](DFHack::DFCoord current) {
         // found a good tile, dig+unset material
-        df::tile_designation des = MCache->designationAt(current);
-        df::tile_designation des_minus;
-        df::tile_designation des_plus;
-        des_plus.whole = des_minus.whole = 0;
-        int16_t vmat_minus = -1;
-        int16_t vmat_plus = -1;
-        int16_t bmat_minus = -1;
-        int16_t bmat_plus = -1;
-        df::tiletype tt_minus;
-        df::tiletype tt_plus;
-
-        if(MCache->testCoord(current))
+        df::tile_designation des = MCache.designationAt(current);
+        if(updown)
         {
-            MCache->setTagAt(current, 1);
-            if(current.x < int32_t(tx_max) - 2)
+            if(current.z > 0 && same_layer(current-1))
             {
-                flood.push(DFHack::DFCoord(current.x + 1, current.y, current.z));
-                if(current.y < int32_t(ty_max) - 2)
-                {
-                    flood.push(DFHack::DFCoord(current.x + 1, current.y + 1, current.z));
-                    flood.push(DFHack::DFCoord(current.x, current.y + 1, current.z));
-                }
-                if(current.y > 1)
-                {
-                    flood.push(DFHack::DFCoord(current.x + 1, current.y - 1, current.z));
-                    flood.push(DFHack::DFCoord(current.x, current.y - 1, current.z));
-                }
-            }
-            if(current.x > 1)
-            {
-                flood.push(DFHack::DFCoord(current.x - 1, current.y, current.z));
-                if(current.y < int32_t(ty_max) - 2)
-                {
-                    flood.push(DFHack::DFCoord(current.x - 1, current.y + 1, current.z));
-                    flood.push(DFHack::DFCoord(current.x, current.y + 1, current.z));
-                }
-                if(current.y > 1)
-                {
-                    flood.push(DFHack::DFCoord(current.x - 1, current.y - 1, current.z));
-                    flood.push(DFHack::DFCoord(current.x, current.y - 1, current.z));
-                }
+                df::tile_designation des_minus = MCache.designationAt(current-1);
+                if(des_minus.bits.dig == tile_dig_designation::DownStair)
+                    des_minus.bits.dig = tile_dig_designation::UpDownStair;
+                else
+                    des_minus.bits.dig = tile_dig_designation::UpStair;
+                // undo mode: clear designation
+                if(undo)
+                    des_minus.bits.dig = tile_dig_designation::No;
+                MCache.setDesignationAt(current-1,des_minus,priority);
+
+                des.bits.dig = tile_dig_designation::DownStair;
             }
-            if(updown)
+            if(current.z < int32_t(z_max) - 1 && same_layer(current+1))
             {
-                bool below = 0;
-                bool above = 0;
-                if(MCache->testCoord(current-1))
-                {
-                    //below = 1;
-                    des_minus = MCache->designationAt(current-1);
-                    vmat_minus = MCache->veinMaterialAt(current-1);
-                    bmat_minus = MCache->layerMaterialAt(current-1);
-                    tt_minus = MCache->tiletypeAt(current-1);
-                    if (   tileMaterial(tt_minus)==tiletype_material::STONE
-                        || tileMaterial(tt_minus)==tiletype_material::SOIL)
-                        below = 1;
-                }
-                if(MCache->testCoord(current+1))
-                {
-                    //above = 1;
-                    des_plus = MCache->designationAt(current+1);
-                    vmat_plus = MCache->veinMaterialAt(current+1);
-                    bmat_plus = MCache->layerMaterialAt(current+1);
-                    tt_plus = MCache->tiletypeAt(current+1);
-                    if (   tileMaterial(tt_plus)==tiletype_material::STONE
-                        || tileMaterial(tt_plus)==tiletype_material::SOIL)
-                        above = 1;
-                }
-                if(current.z > 0 && below && vmat_minus == -1 && bmat_minus == basemat)
-                {
-                    flood.push(current-1);
-
-                    if(des_minus.bits.dig == tile_dig_designation::DownStair)
-                        des_minus.bits.dig = tile_dig_designation::UpDownStair;
-                    else
-                        des_minus.bits.dig = tile_dig_designation::UpStair;
-                    // undo mode: clear designation
-                    if(undo)
-                        des_minus.bits.dig = tile_dig_designation::No;
-                    MCache->setDesignationAt(current-1,des_minus,priority);
-
-                    des.bits.dig = tile_dig_designation::DownStair;
-                }
-                if(current.z < int32_t(z_max) - 1 && above && vmat_plus == -1 && bmat_plus == basemat)
-                {
-                    flood.push(current+ 1);
-
-                    if(des_plus.bits.dig == tile_dig_designation::UpStair)
-                        des_plus.bits.dig = tile_dig_designation::UpDownStair;
-                    else
-                        des_plus.bits.dig = tile_dig_designation::DownStair;
-                    // undo mode: clear designation
-                    if(undo)
-                        des_plus.bits.dig = tile_dig_designation::No;
-                    MCache->setDesignationAt(current+1,des_plus,priority);
-
-                    if(des.bits.dig == tile_dig_designation::DownStair)
-                        des.bits.dig = tile_dig_designation::UpDownStair;
-                    else
-                        des.bits.dig = tile_dig_designation::UpStair;
-                }
+                df::tile_designation des_plus = MCache.designationAt(current+1);
+                if(des_plus.bits.dig == tile_dig_designation::UpStair)
+                    des_plus.bits.dig = tile_dig_designation::UpDownStair;
+                else
+                    des_plus.bits.dig = tile_dig_designation::DownStair;
+                // undo mode: clear designation
+                if(undo)
+                    des_plus.bits.dig = tile_dig_designation::No;
+                MCache.setDesignationAt(current+1,des_plus,priority);
+
+                if(des.bits.dig == tile_dig_designation::DownStair)
+                    des.bits.dig = tile_dig_designation::UpDownStair;
+                else
+                    des.bits.dig = tile_dig_designation::UpStair;
             }
-            if(des.bits.dig == tile_dig_designation::No)
-                des.bits.dig = tile_dig_designation::Default;
-            // undo mode: clear designation
-            if(undo)
-                des.bits.dig = tile_dig_designation::No;
-            MCache->setDesignationAt(current,des,priority);
         }
-    }
-    MCache->WriteAll();
-    delete MCache;
+        if(des.bits.dig == tile_dig_designation::No)
+            des.bits.dig = tile_dig_designation::Default;
+        // undo mode: clear designation
+        if(undo)
+            des.bits.dig = tile_dig_designation::No;
+        MCache.setDesignationAt(current,des,priority);
+    });
+
+    MCache.WriteAll();
     return CR_OK;
 }
 
@@ -1485,14 +1347,13 @@ command_result digtype (color_ostream &out, vector <string> & parameters)
         return CR_FAILURE;
     }
     DFHack::DFCoord xy ((uint32_t)cx,(uint32_t)cy,cz);
-    MapExtras::MapCache * mCache = new MapExtras::MapCache;
-    df::tile_designation baseDes = mCache->designationAt(xy);
-    df::tiletype tt = mCache->tiletypeAt(xy);
-    int16_t veinmat = mCache->veinMaterialAt(xy);
+    MapExtras::MapCache mCache;
+    df::tile_designation baseDes = mCache.designationAt(xy);
+    df::tiletype tt = mCache.tiletypeAt(xy);
+    int16_t veinmat = mCache.veinMaterialAt(xy);
     if( veinmat == -1 )
     {
         out.printerr("This tile is not a vein.\n");
-        delete mCache;
         return CR_FAILURE;
     }
     out.print("(%d,%d,%d) tiletype: %d, veinmat: %d, designation: 0x%x ... DIGGING!\n", cx,cy,cz, tt, veinmat, baseDes.whole);
@@ -1516,32 +1377,30 @@ command_result digtype (color_ostream &out, vector <string> & parameters)
             for( uint32_t y = 1; y < tileYMax-1; y++ )
             {
                 DFHack::DFCoord current(x,y,z);
-                int16_t vmat2 = mCache->veinMaterialAt(current);
+                int16_t vmat2 = mCache.veinMaterialAt(current);
                 if ( vmat2 != veinmat )
                     continue;
-                tt = mCache->tiletypeAt(current);
+                tt = mCache.tiletypeAt(current);
                 if (!DFHack::isWallTerrain(tt))
                     continue;
                 if (tileMaterial(tt) != df::enums::tiletype_material::MINERAL)
                     continue;
 
                 //designate it for digging
-                if ( !mCache->testCoord(current) )
+                if ( !mCache.testCoord(current) )
                 {
                     out.printerr("testCoord failed at (%d,%d,%d)\n", x, y, z);
-                    delete mCache;
                     return CR_FAILURE;
                 }
 
-                df::tile_designation designation = mCache->designationAt(current);
+                df::tile_designation designation = mCache.designationAt(current);
                 designation.bits.dig = baseDes.bits.dig;
-                mCache->setDesignationAt(current, designation,priority);
+                mCache.setDesignationAt(current, designation,priority);
             }
         }
     }
 
-    mCache->WriteAll();
-    delete mCache;
+    mCache.WriteAll();
     return CR_OK;
 }
 
@@ -1,6 +1,9 @@
 #include "uicommon.h"
 #include "listcolumn.h"
 
+#include <tuple>
+#include <unordered_map>
+
 #include "DataDefs.h"
 
 #include "df/job.h"
@@ -48,8 +51,6 @@
 #include "df/viewscreen_unitst.h"
 #include "df/world_raws.h"
 
-using std::deque;
-
 DFHACK_PLUGIN("dwarfmonitor");
 DFHACK_PLUGIN_IS_ENABLED(is_enabled);
 REQUIRE_GLOBAL(current_weather);
@@ -83,7 +84,6 @@ static bool monitor_jobs = false;
 static bool monitor_misery = true;
 static bool monitor_date = true;
 static bool monitor_weather = true;
-static map<df::unit *, deque<activity_type>> work_history;
 
 static int misery[] = { 0, 0, 0, 0, 0, 0, 0 };
 static bool misery_upto_date = false;
@@ -270,6 +270,149 @@ DFHACK_PLUGIN_LUA_COMMANDS {
 #define JOB_ANIMALS -20
 #define JOB_PRODUCTIVE -21
 
+/*
+ * Work history of all monitored units.
+ *
+ * Each unit gets a slot holding a fixed-size ring buffer of samples; all
+ * slots live in one contiguous array. For every window length the stats
+ * screen can show, per-activity counters are updated as samples enter and
+ * leave the window, so reading the statistics of a unit does not need to
+ * walk its history.
+ */
+class WorkHistory
+{
+public:
+    static const int num_windows = max_history_days / min_window;
+    // activity_type values start at JOB_PRODUCTIVE; leave some room below
+    static const int activity_offset = 32;
+    static const int num_activities = ENUM_LAST_ITEM(job_type) + 1 + activity_offset;
+
+    WorkHistory() : history_len(get_max_history()) {}
+
+    static activity_type activityAt(int index)
+    {
+        return activity_type(index - activity_offset);
+    }
+
+    size_t slotCount() const { return slot_units.size(); }
+    df::unit *unitAt(size_t slot) const { return slot_units[slot]; }
+
+    // Counters of the given slot for the most recent window_days days
+    const uint16_t *getCounts(size_t slot, int window_days) const
+    {
+        int window = window_days / min_window - 1;
+        if (window < 0)
+            window = 0;
+        if (window >= num_windows)
+            window = num_windows - 1;
+        return &counts[(slot * num_windows + window) * num_activities];
+    }
+
+    void add(df::unit *unit, activity_type type)
+    {
+        size_t slot = getSlot(unit);
+        int &head = heads[slot];
+        activity_type *ring = &samples[slot * history_len];
+        int new_index = activityIndex(type);
+
+        for (int window = 0; window < num_windows; window++)
+        {
+            int len = windowLength(window);
+            activity_type old = ring[(head + history_len - len) % history_len];
+            uint16_t *window_counts = &counts[(slot * num_windows + window) * num_activities];
+            window_counts[activityIndex(old)]--;
+            window_counts[new_index]++;
+        }
+
+        ring[head] = type;
+        head = (head + 1) % history_len;
+    }
+
+    void remove(df::unit *unit)
+    {
+        auto it = unit_slots.find(unit);
+        if (it == unit_slots.end())
+            return;
+
+        slot_units[it->second] = NULL;
+        free_slots.push_back(it->second);
+        unit_slots.erase(it);
+    }
+
+    void clear()
+    {
+        unit_slots.clear();
+        slot_units.clear();
+        free_slots.clear();
+        heads.clear();
+        samples.clear();
+        counts.clear();
+    }
+
+private:
+    int history_len;
+
+    std::unordered_map<df::unit*, size_t> unit_slots;
+    vector<df::unit*> slot_units;
+    vector<size_t> free_slots;
+
+    vector<int> heads;
+    vector<activity_type> samples;
+    vector<uint16_t> counts;
+
+    int windowLength(int window) const
+    {
+        return (window + 1) * min_window * ticks_per_day;
+    }
+
+    static int activityIndex(activity_type type)
+    {
+        int index = type + activity_offset;
+        if (index < 0 || index >= num_activities)
+            index = JOB_UNKNOWN + activity_offset;
+        return index;
+    }
+
+    size_t getSlot(df::unit *unit)
+    {
+        auto it = unit_slots.find(unit);
+        if (it != unit_slots.end())
+            return it->second;
+
+        size_t slot;
+        if (!free_slots.empty())
+        {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        else
+        {
+            slot = slot_units.size();
+            slot_units.push_back(NULL);
+            heads.push_back(0);
+            samples.resize(samples.size() + history_len);
+            counts.resize(counts.size() + num_windows * num_activities);
+        }
+
+        unit_slots[unit] = slot;
+        slot_units[slot] = unit;
+
+        // A new unit starts out with a history of unknown activity
+        heads[slot] = 0;
+        std::fill_n(samples.begin() + slot * history_len, history_len, activity_type(JOB_UNKNOWN));
+        for (int window = 0; window < num_windows; window++)
+        {
+            uint16_t *window_counts = &counts[(slot * num_windows + window) * num_activities];
+            std::fill_n(window_counts, num_activities, 0);
+            window_counts[activityIndex(JOB_UNKNOWN)] = windowLength(window);
+        }
+
+        return slot;
+    }
+};
+
+static WorkHistory work_history;
+
 static map<activity_type, string> activity_labels;
 
 static string getActivityLabel(const activity_type activity)
@@ -322,28 +465,29 @@ public:
         dwarves_column.clear();
         dwarf_activity_values.clear();
 
-        for (auto it = work_history.begin(); it != work_history.end();)
+        for (size_t slot = 0; slot < work_history.slotCount(); slot++)
         {
-            auto unit = it->first;
+            auto unit = work_history.unitAt(slot);
+            if (!unit)
+                continue;
+
             if (!Units::isActive(unit))
             {
-                work_history.erase(it++);
+                work_history.remove(unit);
                 continue;
             }
 
-            deque<activity_type> *work_list = &it->second;
-            ++it;
-
             size_t dwarf_total = 0;
             dwarf_activity_values[unit] =  map<activity_type, size_t>();
-            size_t count = window_days * ticks_per_day;
-            for (auto entry = work_list->rbegin(); entry != work_list->rend() && count > 0; entry++, count--)
+            const uint16_t *counts = work_history.getCounts(slot, window_days);
+            for (int i = 0; i < WorkHistory::num_activities; i++)
             {
-                if (*entry == JOB_UNKNOWN || *entry == job_type::DrinkBlood)
+                auto entry = WorkHistory::activityAt(i);
+                if (!counts[i] || entry == JOB_UNKNOWN || entry == job_type::DrinkBlood)
                     continue;
 
-                ++dwarf_total;
-                addDwarfActivity(unit, *entry);
+                dwarf_total += counts[i];
+                addDwarfActivity(unit, entry, counts[i]);
             }
 
             auto &values = dwarf_activity_values[unit];
@@ -388,12 +532,12 @@ public:
         dwarf_activity_column.setHighlight(0);
     }
 
-    void addDwarfActivity(df::unit *unit, const activity_type &activity)
+    void addDwarfActivity(df::unit *unit, const activity_type &activity, size_t count)
     {
         if (dwarf_activity_values[unit].find(activity) == dwarf_activity_values[unit].end())
             dwarf_activity_values[unit][activity] = 0;
 
-        dwarf_activity_values[unit][activity]++;
+        dwarf_activity_values[unit][activity] += count;
     }
 
     string getActivityItem(activity_type activity, size_t value)
@@ -567,30 +711,32 @@ public:
         dwarf_activity_values.clear();
         category_breakdown.clear();
 
-        for (auto it = work_history.begin(); it != work_history.end();)
+        for (size_t slot = 0; slot < work_history.slotCount(); slot++)
         {
-            auto unit = it->first;
+            auto unit = work_history.unitAt(slot);
+            if (!unit)
+                continue;
+
             if (!Units::isActive(unit))
             {
-                work_history.erase(it++);
+                work_history.remove(unit);
                 continue;
             }
 
-            deque<activity_type> *work_list = &it->second;
-            ++it;
-
-            size_t count = window_days * ticks_per_day;
-            for (auto entry = work_list->rbegin(); entry != work_list->rend() && count > 0; entry++, count--)
+            const uint16_t *counts = work_history.getCounts(slot, window_days);
+            for (int i = 0; i < WorkHistory::num_activities; i++)
             {
-                if (*entry == JOB_UNKNOWN)
+                auto entry = WorkHistory::activityAt(i);
+                size_t count = counts[i];
+                if (!count || entry == JOB_UNKNOWN)
                     continue;
 
-                ++fort_activity_count;
+                fort_activity_count += count;
 
-                auto real_activity = *entry;
+                auto real_activity = entry;
                 if (real_activity < 0)
                 {
-                    addFortActivity(real_activity);
+                    addFortActivity(real_activity, count);
                 }
                 else
                 {
@@ -859,8 +1005,8 @@ public:
                         break;
                     }
 
-                    addFortActivity(real_activity);
-                    addCategoryActivity(real_activity, *entry);
+                    addFortActivity(real_activity, count);
+                    addCategoryActivity(real_activity, entry, count);
                 }
 
                 if (dwarf_activity_values.find(real_activity) == dwarf_activity_values.end())
@@ -870,7 +1016,7 @@ public:
                 if (activity_for_dwarf.find(unit) == activity_for_dwarf.end())
                     activity_for_dwarf[unit] = 0;
 
-                ++activity_for_dwarf[unit];
+                activity_for_dwarf[unit] += count;
             }
         }
 
@@ -988,15 +1134,15 @@ public:
         return fort_activity_totals[activity];
     }
 
-    void addFortActivity(const activity_type activity)
+    void addFortActivity(const activity_type activity, size_t count)
     {
         if (fort_activity_totals.find(activity) == fort_activity_totals.end())
             fort_activity_totals[activity] = 0;
 
-        fort_activity_totals[activity]++;
+        fort_activity_totals[activity] += count;
     }
 
-    void addCategoryActivity(const int category, const activity_type activity)
+    void addCategoryActivity(const int category, const activity_type activity, size_t count)
     {
         if (category_breakdown.find(category) == category_breakdown.end())
             category_breakdown[category] = map<activity_type, size_t>();
@@ -1004,7 +1150,7 @@ public:
         if (category_breakdown[category].find(activity) == category_breakdown[category].end())
             category_breakdown[category][activity] = 0;
 
-        category_breakdown[category][activity]++;
+        category_breakdown[category][activity] += count;
     }
 
     void feed(set<df::interface_key> *input)
@@ -1353,6 +1499,15 @@ public:
         preferences_column.clear();
         preference_totals.clear();
 
+        // Index of preferences_store entries by what they refer to
+        std::map<preference_key, size_t> store_index;
+        for (size_t i = 0; i < preferences_store.size(); i++)
+        {
+            preference_key key;
+            if (getPreferenceKey(preferences_store[i].pref, &key) && !store_index.count(key))
+                store_index[key] = i;
+        }
+
         for (auto iter = world->units.active.begin(); iter != world->units.active.end(); iter++)
         {
             df::unit* unit = *iter;
@@ -1372,23 +1527,23 @@ public:
                 auto pref = *it;
                 if (!pref->active)
                     continue;
-                bool foundInStore = false;
-                for (size_t pref_index = 0; pref_index < preferences_store.size(); pref_index++)
+
+                preference_key key;
+                if (getPreferenceKey(*pref, &key))
                 {
-                    if (isMatchingPreference(preferences_store[pref_index].pref, *pref))
+                    auto found = store_index.find(key);
+                    if (found != store_index.end())
                     {
-                        foundInStore = true;
-                        preferences_store[pref_index].dwarves.push_back(unit);
+                        preferences_store[found->second].dwarves.push_back(unit);
+                        continue;
                     }
+                    store_index[key] = preferences_store.size();
                 }
 
-                if (!foundInStore)
-                {
-                    size_t pref_index = preferences_store.size();
-                    preferences_store.resize(pref_index + 1);
-                    preferences_store[pref_index].pref = *pref;
-                    preferences_store[pref_index].dwarves.push_back(unit);
-                }
+                size_t pref_index = preferences_store.size();
+                preferences_store.resize(pref_index + 1);
+                preferences_store[pref_index].pref = *pref;
+                preferences_store[pref_index].dwarves.push_back(unit);
             }
         }
 
@@ -1418,78 +1573,63 @@ public:
         populateDwarfColumn();
     }
 
-    bool isMatchingPreference(df::unit_preference &lhs, df::unit_preference &rhs)
-    {
-        if (lhs.type != rhs.type)
-            return false;
+    typedef std::tuple<int, int, int, int> preference_key;
 
+    // Preferences with equal keys are listed as one entry; returns false for
+    // preference types that should never be grouped
+    static bool getPreferenceKey(const df::unit_preference &pref, preference_key *key)
+    {
         typedef df::unit_preference::T_type T_type;
-        switch (lhs.type)
+        switch (pref.type)
         {
         case (T_type::LikeCreature):
-            if (lhs.creature_id != rhs.creature_id)
-                return false;
-            break;
-
         case (T_type::HateCreature):
-            if (lhs.creature_id != rhs.creature_id)
-                return false;
-            break;
+            *key = preference_key(pref.type, pref.creature_id, 0, 0);
+            return true;
 
         case (T_type::LikeFood):
-            if (lhs.item_type != rhs.item_type)
-                return false;
-            if (lhs.mattype != rhs.mattype || lhs.matindex != rhs.matindex)
-                return false;
-            break;
+            *key = preference_key(pref.type, pref.item_type, pref.mattype, pref.matindex);
+            return true;
 
         case (T_type::LikeItem):
-            if (lhs.item_type != rhs.item_type || lhs.item_subtype != rhs.item_subtype)
-                return false;
-            break;
+            *key = preference_key(pref.type, pref.item_type, pref.item_subtype, 0);
+            return true;
 
         case (T_type::LikeMaterial):
-            if (lhs.mattype != rhs.mattype || lhs.matindex != rhs.matindex)
-                return false;
-            break;
+            *key = preference_key(pref.type, pref.mattype, pref.matindex, 0);
+            return true;
 
         case (T_type::LikePlant):
-            if (lhs.plant_id != rhs.plant_id)
-                return false;
-            break;
+            *key = preference_key(pref.type, pref.plant_id, 0, 0);
+            return true;
 
         case (T_type::LikeShape):
-            if (lhs.shape_id != rhs.shape_id)
-                return false;
-            break;
+            *key = preference_key(pref.type, pref.shape_id, 0, 0);
+            return true;
 
         case (T_type::LikeTree):
-            if (lhs.item_type != rhs.item_type)
-                return false;
-            break;
+            *key = preference_key(pref.type, pref.item_type, 0, 0);
+            return true;
 
         case (T_type::LikeColor):
-            if (lhs.color_id != rhs.color_id)
-                return false;
-            break;
+            *key = preference_key(pref.type, pref.color_id, 0, 0);
+            return true;
 
         case (T_type::LikePoeticForm):
-            return lhs.poetic_form_id == rhs.poetic_form_id;
-            break;
+            *key = preference_key(pref.type, pref.poetic_form_id, 0, 0);
+            return true;
 
         case (T_type::LikeMusicalForm):
-            return lhs.musical_form_id == rhs.musical_form_id;
-            break;
+            *key = preference_key(pref.type, pref.musical_form_id, 0, 0);
+            return true;
 
         case (T_type::LikeDanceForm):
-            return lhs.dance_form_id == rhs.dance_form_id;
-            break;
+            *key = preference_key(pref.type, pref.dance_form_id, 0, 0);
+            return true;
 
         default:
             return false;
         }
-
-        return true;
     }
 
     UIColor getItemColor(const df::unit_preference::T_type &type) const
@@ -1729,15 +1869,7 @@ static void open_stats_screen()
 
 static void add_work_history(df::unit *unit, activity_type type)
 {
-    if (work_history.find(unit) == work_history.end())
-    {
-        auto max_history = get_max_history();
-        for (int i = 0; i < max_history; i++)
-            work_history[unit].push_back(JOB_UNKNOWN);
-    }
-
-    work_history[unit].push_back(type);
-    work_history[unit].pop_front();
+    work_history.add(unit, type);
 }
 
 static bool is_at_leisure(df::unit *unit)
@@ -1777,9 +1909,7 @@ static void update_dwarf_stats(bool is_paused)
 
         if (!DFHack::Units::isActive(unit))
         {
-            auto it = work_history.find(unit);
-            if (it != work_history.end())
-                work_history.erase(it);
+            work_history.remove(unit);
 
             continue;
         }
@@ -108,6 +108,90 @@ DEFINE_LUA_EVENT_NH_3(onUnitAttack, int32_t, int32_t, int32_t);
 DEFINE_LUA_EVENT_NH_0(onUnload);
 DEFINE_LUA_EVENT_NH_6(onInteraction, std::string, std::string, int32_t, int32_t, int32_t, int32_t);
 
+/*
+ * Batched delivery: events that only carry ids can also be queued for the
+ * rest of the frame and passed to onEventBatch in one call per type. The
+ * individual onUnitAttack/onReport/... events still fire for their own
+ * listeners; nothing is queued while onEventBatch has none.
+ */
+static DFHack::Lua::Notification onEventBatch_event;
+
+static const int batchColumns[EventManager::EventType::EVENT_MAX] = {
+    0, // TICK
+    0, // JOB_INITIATED
+    0, // JOB_COMPLETED
+    1, // UNIT_DEATH
+    1, // ITEM_CREATED
+    1, // BUILDING
+    0, // CONSTRUCTION
+    2, // SYNDROME
+    1, // INVASION
+    0, // INVENTORY_CHANGE
+    1, // REPORT
+    3, // UNIT_ATTACK
+    0, // UNLOAD
+    0, // INTERACTION
+};
+
+struct EventBatch {
+    int enabled; // number of scripts that asked for batching
+    std::vector<int32_t> args[3];
+
+    EventBatch() : enabled(0) {}
+
+    size_t size() const { return args[0].size(); }
+    void clear() {
+        // keeps the capacity, so a busy siege settles into no allocations
+        for (int i = 0; i < 3; i++)
+            args[i].clear();
+    }
+};
+
+static EventBatch eventBatches[EventManager::EventType::EVENT_MAX];
+
+static void queueBatched(int evType, int32_t arg1, int32_t arg2 = 0, int32_t arg3 = 0)
+{
+    EventBatch &batch = eventBatches[evType];
+    if (!batch.enabled || !onEventBatch_event.state_if_count())
+        return;
+
+    int32_t args[3] = { arg1, arg2, arg3 };
+    for (int i = 0; i < batchColumns[evType]; i++)
+        batch.args[i].push_back(args[i]);
+}
+
+static void flushBatches(color_ostream &out)
+{
+    auto state = onEventBatch_event.state_if_count();
+
+    for (int evType = 0; evType < EventManager::EventType::EVENT_MAX; evType++)
+    {
+        EventBatch &batch = eventBatches[evType];
+        size_t count = batch.size();
+        if (!count)
+            continue;
+
+        if (state)
+        {
+            int columns = batchColumns[evType];
+            Lua::Push(state, evType);
+            Lua::Push(state, (int)count);
+            for (int i = 0; i < columns; i++)
+            {
+                lua_createtable(state, count, 0);
+                for (size_t j = 0; j < count; j++)
+                {
+                    lua_pushinteger(state, batch.args[i][j]);
+                    lua_rawseti(state, -2, j+1);
+                }
+            }
+            onEventBatch_event.invoke(out, 2 + columns);
+        }
+
+        batch.clear();
+    }
+}
+
 DFHACK_PLUGIN_LUA_EVENTS {
     DFHACK_LUA_EVENT(onWorkshopFillSidebarMenu),
     DFHACK_LUA_EVENT(postWorkshopFillSidebarMenu),
@@ -132,6 +216,7 @@ DFHACK_PLUGIN_LUA_EVENTS {
     DFHACK_LUA_EVENT(onUnitAttack),
     DFHACK_LUA_EVENT(onUnload),
     DFHACK_LUA_EVENT(onInteraction),
+    DFHACK_LUA_EVENT(onEventBatch),
     DFHACK_LUA_END
 };
 
@@ -148,11 +233,13 @@ void ev_mng_jobCompleted(color_ostream& out, void* job)
 void ev_mng_unitDeath(color_ostream& out, void* ptr)
 {
     int32_t myId=(int32_t)(intptr_t)ptr;
+    queueBatched(EventManager::EventType::UNIT_DEATH,myId);
     onUnitDeath(out,myId);
 }
 void ev_mng_itemCreate(color_ostream& out, void* ptr)
 {
     int32_t myId=(int32_t)(intptr_t)ptr;
+    queueBatched(EventManager::EventType::ITEM_CREATED,myId);
     onItemCreated(out,myId);
 }
 void ev_mng_construction(color_ostream& out, void* ptr)
@@ -163,16 +250,19 @@ void ev_mng_construction(color_ostream& out, void* ptr)
 void ev_mng_syndrome(color_ostream& out, void* ptr)
 {
     EventManager::SyndromeData* data=reinterpret_cast<EventManager::SyndromeData*>(ptr);
+    queueBatched(EventManager::EventType::SYNDROME,data->unitId,data->syndromeIndex);
     onSyndrome(out,data->unitId,data->syndromeIndex);
 }
 void ev_mng_invasion(color_ostream& out, void* ptr)
 {
     int32_t myId=(int32_t)(intptr_t)ptr;
+    queueBatched(EventManager::EventType::INVASION,myId);
     onInvasion(out,myId);
 }
 static void ev_mng_building(color_ostream& out, void* ptr)
 {
     int32_t id=(int32_t)(intptr_t)ptr;
+    queueBatched(EventManager::EventType::BUILDING,id);
     onBuildingCreatedDestroyed(out, id);
 }
 static void ev_mng_inventory(color_ostream& out, void* ptr)
@@ -193,10 +283,13 @@ static void ev_mng_inventory(color_ostream& out, void* ptr)
     onInventoryChange(out,unitId,itemId,item_old,item_new);
 }
 static void ev_mng_report(color_ostream& out, void* ptr) {
-    onReport(out,(int32_t)(intptr_t)ptr);
+    int32_t id = (int32_t)(intptr_t)ptr;
+    queueBatched(EventManager::EventType::REPORT,id);
+    onReport(out,id);
 }
 static void ev_mng_unitAttack(color_ostream& out, void* ptr) {
     EventManager::UnitAttackData* data = (EventManager::UnitAttackData*)ptr;
+    queueBatched(EventManager::EventType::UNIT_ATTACK,data->attacker,data->defender,data->wound);
     onUnitAttack(out,data->attacker,data->defender,data->wound);
 }
 static void ev_mng_unload(color_ostream& out, void* ptr) {
@@ -242,8 +335,20 @@ static void enableEvent(int evType,int freq)
     EventManager::registerListener(typeToEnable,EventManager::EventHandler(fun_ptr,freq),plugin_self);
     enabledEventManagerEvents[typeToEnable] = freq;
 }
+static void setEventBatching(int evType, bool enable)
+{
+    CHECK_INVALID_ARGUMENT(evType >= 0 && evType < EventManager::EventType::EVENT_MAX);
+    CHECK_INVALID_ARGUMENT(!enable || batchColumns[evType] > 0);
+
+    EventBatch &batch = eventBatches[evType];
+    if (enable)
+        batch.enabled++;
+    else if (batch.enabled > 0 && --batch.enabled == 0)
+        batch.clear();
+}
 DFHACK_PLUGIN_LUA_FUNCTIONS{
     DFHACK_LUA_FUNCTION(enableEvent),
+    DFHACK_LUA_FUNCTION(setEventBatching),
     DFHACK_LUA_END
 };
 struct workshop_hook : df::building_workshopst{
@@ -453,6 +558,8 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
         break;
     case SC_WORLD_UNLOADED:
         world_specific_hooks(out,false);
+        for (int i = 0; i < EventManager::EventType::EVENT_MAX; i++)
+            eventBatches[i].clear();
 
         break;
     default:
@@ -462,6 +569,13 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
+DFhackCExport command_result plugin_onupdate ( color_ostream &out )
+{
+    // EventManager has already run for this update
+    flushBatches(out);
+    return CR_OK;
+}
+
 DFhackCExport command_result plugin_init ( color_ostream &out, std::vector <PluginCommand> &commands)
 {
     if (Core::getInstance().isWorldLoaded())
@@ -9,10 +9,10 @@
 #include "Console.h"
 #include "Export.h"
 #include "PluginManager.h"
+#include "modules/FloodFill.h"
 #include "modules/Maps.h"
 #include "modules/MapCache.h"
 #include "modules/Gui.h"
-using std::stack;
 using MapExtras::MapCache;
 using namespace DFHack;
 using namespace df::enums;
@@ -91,8 +91,6 @@ command_result filltraffic(color_ostream &out, std::vector<std::string> & params
 {
     // HOTKEY COMMAND; CORE ALREADY SUSPENDED
 
-    //Maximum map size.
-    uint32_t x_max,y_max,z_max;
     //Source and target traffic types.
     df::tile_traffic source = tile_traffic::Normal;
     df::tile_traffic target = tile_traffic::Normal;
@@ -135,9 +133,6 @@ command_result filltraffic(color_ostream &out, std::vector<std::string> & params
     }
 
     int32_t cx, cy, cz;
-    Maps::getSize(x_max,y_max,z_max);
-    uint32_t tx_max = x_max * 16;
-    uint32_t ty_max = y_max * 16;
     Gui::getCursorCoords(cx,cy,cz);
     while(cx == -30000)
     {
@@ -182,66 +177,38 @@ command_result filltraffic(color_ostream &out, std::vector<std::string> & params
 
     out.print("%d/%d/%d  ... FILLING!\n", cx,cy,cz);
 
-    //Naive four-way or six-way flood fill with possible tiles on a stack.
-    stack <DFCoord> flood;
-    flood.push(xy);
-
-    while(!flood.empty())
-    {
-        xy = flood.top();
-        flood.pop();
-
-        des = MCache.designationAt(xy);
-        if (des.bits.traffic != source) continue;
-
-        tt = MCache.tiletypeAt(xy);
-
-        if(isWallTerrain(tt)) continue;
-        if(checkpit && isOpenTerrain(tt)) continue;
-
-        if (checkbuilding)
-        {
-            oc = MCache.occupancyAt(xy);
-            if(oc.bits.building) continue;
-        }
-
-        //This tile is ready.  Set its traffic level and add surrounding tiles.
-        if (MCache.testCoord(xy))
-        {
-            des.bits.traffic = target;
-            MCache.setDesignationAt(xy,des);
-
-            if (xy.x > 0)
-            {
-                flood.push(DFCoord(xy.x - 1, xy.y, xy.z));
-            }
-            if (xy.x < int32_t(tx_max) - 1)
-            {
-                flood.push(DFCoord(xy.x + 1, xy.y, xy.z));
-            }
-            if (xy.y > 0)
-            {
-                flood.push(DFCoord(xy.x, xy.y - 1, xy.z));
-            }
-            if (xy.y < int32_t(ty_max) - 1)
-            {
-                flood.push(DFCoord(xy.x, xy.y + 1, xy.z));
-            }
-
-            if (updown)
-            {
-                if (xy.z > 0 && LowPassable(tt))
-                {
-                    flood.push(DFCoord(xy.x, xy.y, xy.z - 1));
-                }
-                if (xy.z < int32_t(z_max) && HighPassable(tt))
-                {
-                    flood.push(DFCoord(xy.x, xy.y, xy.z + 1));
-                }
-            }
-
-        }
-    }
+    //Four-way or six-way scanline flood fill.
+    FloodFill::Engine filler(
+        [&](DFCoord pos) {
+            if (!MCache.testCoord(pos))
+                return false;
+
+            if (MCache.designationAt(pos).bits.traffic != source)
+                return false;
+
+            df::tiletype tt = MCache.tiletypeAt(pos);
+            if (isWallTerrain(tt)) return false;
+            if (checkpit && isOpenTerrain(tt)) return false;
+
+            if (checkbuilding && MCache.occupancyAt(pos).bits.building)
+                return false;
+
+            return true;
+        },
+        updown ? FloodFill::VERTICAL : 0
+    );
+
+    filler.setVerticalTest([&](DFCoord pos, int dz) {
+        df::tiletype tt = MCache.tiletypeAt(pos);
+        return dz < 0 ? LowPassable(tt) : HighPassable(tt);
+    });
+
+    //Each tile is ready when visited.  Set its traffic level.
+    filler.fill(xy, [&](DFCoord pos) {
+        df::tile_designation des = MCache.designationAt(pos);
+        des.bits.traffic = target;
+        MCache.setDesignationAt(pos, des);
+    });
 
     MCache.WriteAll();
     return CR_OK;
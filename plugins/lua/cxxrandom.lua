@@ -1,13 +1,16 @@
 local _ENV = mkmodule('plugins.cxxrandom')
 
-function MakeNewEngine(seed)
+function MakeNewEngine(seed, kind)
+    if type(kind) ~= 'nil' and type(kind) ~= 'string' then
+        error("Argument `kind` must be a string, or nil.")
+    end
     if type(seed) == 'number' then
         if seed == 0 then
             print(":WARNING: Seeds equal to 0 are used if no seed is provided. This indicates to cxxrandom.plug.dll that the engine needs to be seeded with the current time.\nRecommendation: use a non-zero value for your seed, or don't provide a seed to use the time since epoch(1969~).")
         end
-        return GenerateEngine(seed)
+        return GenerateFastEngine(kind or 'mt19937_64', seed)
     elseif type(seed) == 'nil' then
-        return GenerateEngine(0)
+        return GenerateFastEngine(kind or 'mt19937_64', 0)
     else
         error("Argument `seed` must be a number, or nil.")
     end
@@ -82,6 +85,29 @@ function crng:next()
         error("crng object does not have a valid number distribution set")
     end
 end
+function crng:bulk(count, target)
+    if type(self.distrib) == 'table' and type(self.distrib.bulk) == 'function' then
+        return self.distrib:bulk(self.rngID, count, target)
+    else
+        error("crng object does not have a distribution that supports bulk generation")
+    end
+end
+--distributions only hold their parameters, so the stream gets its own copy;
+--native ones (num_sequence) are shared, as they cannot be copied
+local function copyDistrib(distrib)
+    local mt = getmetatable(distrib)
+    if type(distrib) ~= 'table' or (mt and mt.__gc) then
+        return distrib
+    end
+    local o = {}
+    for k,v in pairs(distrib) do
+        o[k] = v
+    end
+    return setmetatable(o, mt)
+end
+function crng:stream(n)
+    return crng:new(GenerateStream(self.rngID, n), true, copyDistrib(self.distrib))
+end
 function crng:shuffle()
     if type(self.distrib) == 'table' and type(self.distrib.shuffle) == 'function' then
         self.distrib:shuffle(self.rngID)
@@ -108,6 +134,9 @@ end
 function normal_distribution:next(id)
     return rollNormal(id, self.average, self.std_deviation)
 end
+function normal_distribution:bulk(id, count, target)
+    return rollNormalBulk(id, self.average, self.std_deviation, count, target)
+end
 
 --Class: real_distribution
 ----------------------------
@@ -126,6 +155,9 @@ end
 function real_distribution:next(id)
     return rollDouble(id, self.min, self.max)
 end
+function real_distribution:bulk(id, count, target)
+    return rollDoubleBulk(id, self.min, self.max, count, target)
+end
 
 --Class: int_distribution
 ----------------------------
@@ -144,6 +176,9 @@ end
 function int_distribution:next(id)
     return rollInt(id, self.min, self.max)
 end
+function int_distribution:bulk(id, count, target)
+    return rollIntBulk(id, self.min, self.max, count, target)
+end
 
 --Class: bool_distribution
 ----------------------------
@@ -161,6 +196,9 @@ end
 function bool_distribution:next(id)
     return rollBool(id, self.p)
 end
+function bool_distribution:bulk(id, count, target)
+    return rollBoolBulk(id, self.p, count, target)
+end
 
 --Class: num_sequence
 ----------------------------
@@ -204,11 +242,12 @@ end
 function num_sequence:next()
     return NextInSequence(self.seqID)
 end
-function num_sequence:shuffle()
-    if self.rngID == 'nil' then
+function num_sequence:shuffle(id)
+    id = id or self.rngID
+    if id == nil then
         error("Add num_sequence object to crng as distribution, before attempting to shuffle.")
     end
-    ShuffleSequence(self.rngID, self.seqID)
+    ShuffleSequence(id, self.seqID)
 end
 
 return _ENV
\ No newline at end of file
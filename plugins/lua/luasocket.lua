@@ -43,7 +43,7 @@ function socket:select(sec,msec)
     return _funcs.lua_socket_select(self.server_id,self.client_id,sec,msec)
 end
 local client=defclass(client,socket)
-function client:receive( pattern )
+local function receive(self,pattern,nowait)
     local pattern=pattern or "*l"
     local bytes=-1
     
@@ -51,15 +51,27 @@ function client:receive( pattern )
         bytes=pattern
     end
 
-    local ret=_funcs.lua_client_receive(self.server_id,self.client_id,bytes,pattern,false)
+    local ret=_funcs.lua_client_receive(self.server_id,self.client_id,bytes,pattern,false,nowait)
     if ret=="" then
         return
     else
         return ret
     end
 end
+function client:receive( pattern )
+    return receive(self,pattern,false)
+end
+function client:tryReceive( pattern )
+    return receive(self,pattern,true)
+end
+function client:buffered()
+    return _funcs.lua_client_buffered(self.server_id,self.client_id)
+end
 function client:send( data )
-    _funcs.lua_client_send(self.server_id,self.client_id,data)
+    return _funcs.lua_client_send(self.server_id,self.client_id,data)
+end
+function client:flush()
+    return _funcs.lua_client_flush(self.server_id,self.client_id)
 end
 
 
@@ -82,5 +94,40 @@ function tcp:connect( address,port )
     local id=_funcs.lua_socket_connect(address,port)
     return client{client_id=id}
 end
+function tcp:poll( recvt,sendt,sec,msec )
+    local ids,socks,events,index={},{},{},{}
+    local function add(list,flag)
+        for _,sock in ipairs(list or {}) do
+            local i=index[sock]
+            if not i then
+                table.insert(socks,sock)
+                i=#socks
+                index[sock]=i
+                events[i]=0
+            end
+            events[i]=events[i] | flag
+        end
+    end
+    add(recvt,1)
+    add(sendt,2)
+    for i,sock in ipairs(socks) do
+        table.insert(ids,sock.server_id)
+        table.insert(ids,sock.client_id)
+        table.insert(ids,events[i])
+    end
+    --without a timeout only check, so the game is never stalled by accident
+    local timeout=math.floor((sec or 0)*1000+(msec or 0))
+    local ready=_funcs.lua_socket_poll(ids,timeout)
+    local readable,writable={},{}
+    for i,sock in ipairs(socks) do
+        if ready[i] & 5 ~= 0 and events[i] & 1 ~= 0 then
+            table.insert(readable,sock)
+        end
+        if ready[i] & 2 ~= 0 then
+            table.insert(writable,sock)
+        end
+    end
+    return readable,writable
+end
 --TODO garbage collect stuff
 return _ENV
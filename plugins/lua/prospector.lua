@@ -0,0 +1,11 @@
+local _ENV = mkmodule('plugins.prospector')
+
+--[[
+
+ Native functions:
+
+ * getHistograms([options])
+
+--]]
+
+return _ENV
@@ -15,6 +15,12 @@
 #include "DataFuncs.h"
 #include <stdexcept> //todo convert errors to lua-errors and co. Then remove this
 
+#ifdef _WIN32
+#define poll WSAPoll
+#else
+#include <poll.h>
+#endif
+
 using namespace DFHack;
 using namespace df::enums;
 struct server
@@ -27,6 +33,44 @@ struct server
 std::map<int,server> servers;
 typedef std::map<int,CActiveSocket*> clients_map;
 clients_map clients; //free clients, i.e. non-server spawned clients
+
+// Per-connection buffers. Data is received in large chunks and lines and
+// byte counts are cut out of in, instead of asking the socket for one byte
+// at a time. Sends that a non-blocking socket could not take right away
+// wait in out until the next send or flush.
+struct socket_buffers
+{
+    std::string in;
+    size_t in_pos;
+    std::string out;
+
+    socket_buffers() : in_pos(0) {}
+
+    size_t available() const
+    {
+        return in.size()-in_pos;
+    }
+    std::string take(size_t count)
+    {
+        std::string ret=in.substr(in_pos,count);
+        in_pos+=ret.size();
+        // compact once the consumed prefix dominates the buffer
+        if(in_pos==in.size())
+        {
+            in.clear();
+            in_pos=0;
+        }
+        else if(in_pos>=size_t(recv_chunk) && in_pos*2>=in.size())
+        {
+            in.erase(0,in_pos);
+            in_pos=0;
+        }
+        return ret;
+    }
+
+    static const int32_t recv_chunk=65536;
+};
+std::map<CSimpleSocket*,socket_buffers> buffers;
 DFHACK_PLUGIN("luasocket");
 
 
@@ -35,6 +79,7 @@ void server::close()
     for(auto it=clients.begin();it!=clients.end();it++)
     {
         CActiveSocket* sock=it->second;
+        buffers.erase(sock);
         sock->Close();
         delete sock;
     }
@@ -72,6 +117,54 @@ void handle_error(CSimpleSocket::CSocketError err,bool skip_timeout=true)
         return;
     throw std::runtime_error(CSimpleSocket::DescribeError(err));
 }
+// Waits up to timeout_ms for the given poll events; returns the events that occurred
+static short wait_socket(CSimpleSocket *sock,short events,int timeout_ms)
+{
+    pollfd fd;
+    fd.fd=sock->GetSocketDescriptor();
+    fd.events=events;
+    fd.revents=0;
+    if(poll(&fd,1,timeout_ms)<=0)
+        return 0;
+    return fd.revents;
+}
+// Reads one chunk of whatever is available into the input buffer. Returns the
+// number of bytes read, 0 if the peer has closed the connection, or -1 if no
+// data arrived (timeout, would block, or nowait and nothing is pending).
+static int fill_buffer(CActiveSocket *sock,socket_buffers &buf,bool fail_on_timeout,bool nowait)
+{
+    if(nowait && !wait_socket(sock,POLLIN,0))
+        return -1;
+    int32_t received=sock->Receive(socket_buffers::recv_chunk);
+    if(received<0)
+    {
+        handle_error(sock->GetSocketError(),!fail_on_timeout);
+        return -1;
+    }
+    buf.in.append((const char*)sock->GetData(),received);
+    return received;
+}
+// Sends as much of the output buffer as the socket takes; returns the number of bytes left
+static size_t flush_buffer(CActiveSocket *sock,socket_buffers &buf)
+{
+    size_t sent_total=0;
+    while(sent_total<buf.out.size())
+    {
+        int32_t sent=sock->Send((const uint8_t*)buf.out.data()+sent_total,buf.out.size()-sent_total);
+        if(sent<0)
+        {
+            CSimpleSocket::CSocketError err=sock->GetSocketError();
+            buf.out.erase(0,sent_total);
+            handle_error(err);
+            return buf.out.size();
+        }
+        if(sent==0)
+            break;
+        sent_total+=sent;
+    }
+    buf.out.erase(0,sent_total);
+    return buf.out.size();
+}
 static int lua_socket_bind(std::string ip,int port)
 {
     static int server_id=0;
@@ -103,7 +196,7 @@ static int lua_server_accept(int id,bool fail_on_timeout)
     CActiveSocket* sock=cur_server.socket->Accept();
     if(!sock)
     {
-        handle_error(sock->GetSocketError(),!fail_on_timeout);
+        handle_error(cur_server.socket->GetSocketError(),!fail_on_timeout);
         return 0;
     }
     else
@@ -121,6 +214,7 @@ static void lua_client_close(int server_id,int client_id)
     std::map<int,CActiveSocket*>* target=info.second;
 
     target->erase(client_id);
+    buffers.erase(sock);
     CSimpleSocket::CSocketError err=CSimpleSocket::SocketSuccess;
     if(!sock->Close())
         err=sock->GetSocketError();
@@ -146,88 +240,83 @@ static void lua_server_close(int server_id)
         throw;
     }
 }
-static std::string lua_client_receive(int server_id,int client_id,int bytes,std::string pattern,bool fail_on_timeout)
+static std::string lua_client_receive(int server_id,int client_id,int bytes,std::string pattern,bool fail_on_timeout,bool nowait)
 {
     auto info=get_client(server_id,client_id);
     CActiveSocket *sock=info.first;
+    socket_buffers &buf=buffers[sock];
     if(bytes>0)
     {
-        if(sock->Receive(bytes)<=0)
+        while(buf.available()<size_t(bytes))
         {
-            throw std::runtime_error(sock->DescribeError());
+            int received=fill_buffer(sock,buf,fail_on_timeout,nowait);
+            if(received<0)
+                return ""; //partial data stays buffered for the next call
+            if(received==0)
+                return buf.take(buf.available());
         }
-        return std::string((char*)sock->GetData(),bytes);
+        return buf.take(bytes);
     }
-    else
+    else if(pattern=="*a")
     {
-        std::string ret;
-        if(pattern=="*a") //??
-        {
-            while(true)
-            {
-                int received=sock->Receive(1);
-                if(received<0)
-                {
-                    handle_error(sock->GetSocketError(),!fail_on_timeout);
-                    return "";//maybe return partial string?
-                }
-                else if(received==0)
-                {
-                    break;
-                }
-                ret+=(char)*sock->GetData();
-
-            }
-            return ret;
-        }
-        else if (pattern=="" || pattern=="*l")
-        {
-            while(true)
-            {
-
-                if(sock->Receive(1)<=0)
-                {
-                    handle_error(sock->GetSocketError(),!fail_on_timeout);
-                    return "";//maybe return partial string?
-                }
-                char rec=(char)*sock->GetData();
-                if(rec=='\n')
-                    break;
-                ret+=rec;
-            }
-            return ret;
-        }
-        else
+        //everything until the connection closes; with nowait, until no more data is available
+        while(true)
         {
-            throw std::runtime_error("Unsupported receive pattern");
+            int received=fill_buffer(sock,buf,fail_on_timeout,nowait);
+            if(received==0 || (received<0 && nowait))
+                return buf.take(buf.available());
+            if(received<0)
+                return ""; //partial data stays buffered for the next call
         }
     }
-}
-static void lua_client_send(int server_id,int client_id,std::string data)
-{
-    if(data.size()==0)
-        return;
-    std::map<int,CActiveSocket*>* target=&clients;
-    if(server_id>0)
+    else if (pattern=="" || pattern=="*l")
     {
-        if(servers.count(server_id)==0)
+        size_t scan=buf.in_pos;
+        while(true)
         {
-            throw std::runtime_error("Server with this id does not exist");
+            size_t newline=buf.in.find('\n',scan);
+            if(newline!=std::string::npos)
+            {
+                std::string ret=buf.take(newline-buf.in_pos);
+                buf.take(1);
+                return ret;
+            }
+            scan=buf.in.size();
+            int received=fill_buffer(sock,buf,fail_on_timeout,nowait);
+            if(received<0)
+                return ""; //partial line stays buffered for the next call
+            if(received==0)
+                return buf.take(buf.available());
         }
-        server &cur_server=servers[server_id];
-        target=&cur_server.clients;
     }
-
-    if(target->count(client_id)==0)
-    {
-        throw std::runtime_error("Client does with this id not exist");
-    }
-    CActiveSocket *sock=(*target)[client_id];
-    if(size_t(sock->Send((const uint8_t*)data.c_str(),data.size()))!=data.size())
+    else
     {
-        throw std::runtime_error(sock->DescribeError());
+        throw std::runtime_error("Unsupported receive pattern");
     }
 }
+static int lua_client_send(int server_id,int client_id,std::string data)
+{
+    CActiveSocket *sock=get_client(server_id,client_id).first;
+    socket_buffers &buf=buffers[sock];
+    buf.out+=data;
+    return flush_buffer(sock,buf);
+}
+static int lua_client_flush(int server_id,int client_id)
+{
+    CActiveSocket *sock=get_client(server_id,client_id).first;
+    auto it=buffers.find(sock);
+    if(it==buffers.end())
+        return 0;
+    return flush_buffer(sock,it->second);
+}
+static int lua_client_buffered(int server_id,int client_id)
+{
+    CActiveSocket *sock=get_client(server_id,client_id).first;
+    auto it=buffers.find(sock);
+    if(it==buffers.end())
+        return 0;
+    return it->second.available();
+}
 static int lua_socket_connect(std::string ip,int port)
 {
     static int last_client_id=0;
@@ -312,6 +401,59 @@ static bool lua_socket_is_blocking(int server_id, int client_id)
     CSimpleSocket *sock = get_socket(server_id, client_id);
     return !sock->IsNonblocking();
 }
+// lua_socket_poll({server_id, client_id, events, ...}, timeout_ms)
+// events/result flags: 1 - readable (or acceptable), 2 - writable, 4 - error or hangup
+// Returns a table with the resulting flags of each socket, in the same order.
+static int lua_socket_poll(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    int timeout_ms = int(luaL_optinteger(L, 2, 0));
+    int count = int(lua_rawlen(L, 1) / 3);
+
+    std::vector<pollfd> fds(count);
+    std::vector<int> ready(count, 0);
+    for (int i = 0; i < count; i++)
+    {
+        lua_rawgeti(L, 1, 3*i + 1);
+        lua_rawgeti(L, 1, 3*i + 2);
+        lua_rawgeti(L, 1, 3*i + 3);
+        int server_id = lua_tointeger(L, -3);
+        int client_id = lua_tointeger(L, -2);
+        int events = lua_tointeger(L, -1);
+        lua_pop(L, 3);
+
+        CSimpleSocket *sock = get_socket(server_id, client_id);
+        fds[i].fd = sock->GetSocketDescriptor();
+        fds[i].events = ((events & 1) ? POLLIN : 0) | ((events & 2) ? POLLOUT : 0);
+        fds[i].revents = 0;
+
+        // data already buffered is readable without touching the socket
+        auto it = buffers.find(sock);
+        if ((events & 1) && it != buffers.end() && it->second.available() > 0)
+        {
+            ready[i] |= 1;
+            timeout_ms = 0;
+        }
+    }
+
+    if (count > 0 && poll(&fds[0], count, timeout_ms) < 0)
+        luaL_error(L, "poll failed");
+
+    lua_createtable(L, count, 0);
+    for (int i = 0; i < count; i++)
+    {
+        short revents = fds[i].revents;
+        if (revents & POLLIN)
+            ready[i] |= 1;
+        if (revents & POLLOUT)
+            ready[i] |= 2;
+        if (revents & (POLLERR | POLLHUP | POLLNVAL))
+            ready[i] |= 4;
+        lua_pushinteger(L, ready[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
 DFHACK_PLUGIN_LUA_FUNCTIONS {
     DFHACK_LUA_FUNCTION(lua_socket_bind), //spawn a server
     DFHACK_LUA_FUNCTION(lua_socket_connect),//spawn a client (i.e. connection)
@@ -323,9 +465,15 @@ DFHACK_PLUGIN_LUA_FUNCTIONS {
     DFHACK_LUA_FUNCTION(lua_server_close),
     DFHACK_LUA_FUNCTION(lua_client_close),
     DFHACK_LUA_FUNCTION(lua_client_send),
+    DFHACK_LUA_FUNCTION(lua_client_flush),
+    DFHACK_LUA_FUNCTION(lua_client_buffered),
     DFHACK_LUA_FUNCTION(lua_client_receive),
     DFHACK_LUA_END
 };
+DFHACK_PLUGIN_LUA_COMMANDS {
+    DFHACK_LUA_COMMAND(lua_socket_poll),
+    DFHACK_LUA_END
+};
 DFhackCExport command_result plugin_init ( color_ostream &out, std::vector <PluginCommand> &commands)
 {
 
@@ -345,5 +493,6 @@ DFhackCExport command_result plugin_shutdown ( color_ostream &out )
         it->second.close();
     }
     servers.clear();
+    buffers.clear();
     return CR_OK;
 }
@@ -10,19 +10,25 @@
 #include <iomanip>
 #include <map>
 #include <algorithm>
+#include <atomic>
 #include <functional>
+#include <thread>
 #include <vector>
 
 using namespace std;
 #include "Core.h"
 #include "Console.h"
 #include "Export.h"
+#include "LuaTools.h"
 #include "PluginManager.h"
 #include "modules/Gui.h"
 #include "modules/MapCache.h"
 
 #include "MiscUtils.h"
 
+#include "RemoteServer.h"
+#include "prospector.pb.h"
+
 #include "DataDefs.h"
 #include "df/world.h"
 #include "df/world_data.h"
@@ -39,6 +45,7 @@ using namespace std;
 
 using namespace DFHack;
 using namespace df::enums;
+using namespace dfproto;
 using df::coord2d;
 
 DFHACK_PLUGIN("prospector");
@@ -75,6 +82,18 @@ struct matdata
         }
         return count;
     }
+    void merge(const matdata &other)
+    {
+        count += other.count;
+        if(other.lower_z != invalid_z && (lower_z == invalid_z || other.lower_z < lower_z))
+        {
+            lower_z = other.lower_z;
+        }
+        if(other.upper_z != invalid_z && (upper_z == invalid_z || other.upper_z > upper_z))
+        {
+            upper_z = other.upper_z;
+        }
+    }
     unsigned int count;
     int lower_z;
     int upper_z;
@@ -102,6 +121,36 @@ typedef std::vector< pair<int16_t, matdata> > MatSorter;
 
 typedef std::vector<df::plant *> PlantList;
 
+// Dense per-material counters, indexed directly by material id
+typedef std::vector<matdata> MatHistogram;
+
+static const unsigned MAX_SCAN_THREADS = 16;
+
+static void histogram_add(MatHistogram &hist, int index, int z_level)
+{
+    if (index < 0)
+        return;
+    if (size_t(index) >= hist.size())
+        hist.resize(index + 1);
+    hist[index].add(z_level);
+}
+
+static void histogram_merge(MatHistogram &hist, const MatHistogram &other)
+{
+    if (other.size() > hist.size())
+        hist.resize(other.size());
+    for (size_t i = 0; i < other.size(); i++)
+        if (other[i].count)
+            hist[i].merge(other[i]);
+}
+
+static void histogram_to_map(const MatHistogram &hist, MatMap &out)
+{
+    for (size_t i = 0; i < hist.size(); i++)
+        if (hist[i].count)
+            out[int16_t(i)] = hist[i];
+}
+
 #define TO_PTR_VEC(obj_vec, ptr_vec) \
     ptr_vec.clear(); \
     for (size_t i = 0; i < obj_vec.size(); i++) \
@@ -555,228 +604,340 @@ static command_result embark_prospector(color_ostream &out, df::viewscreen_choos
     return CR_OK;
 }
 
-command_result prospector (color_ostream &con, vector <string> & parameters)
+
+/*
+ * Map scanning engine
+ *
+ * The map is partitioned into block columns, which are handed out to
+ * worker threads on demand. Every worker owns a MapCache and a set of
+ * dense histograms indexed by material id; these are merged once all
+ * columns are done. The core is kept suspended by the calling thread for
+ * the whole duration of the scan, so the workers only ever read.
+ */
+
+struct ProspectOptions
 {
-    bool showHidden = false;
-    bool showPlants = true;
-    bool showSlade = true;
-    bool showTemple = true;
-    bool showValue = false;
-    bool showTube = false;
+    bool showHidden;
+    bool showPlants;
+    bool showSlade;
+    bool showTemple;
+
+    ProspectOptions()
+        : showHidden(false), showPlants(true), showSlade(true), showTemple(true)
+    {}
+};
 
-    for(size_t i = 0; i < parameters.size();i++)
-    {
-        if (parameters[i] == "all")
-        {
-            showHidden = true;
-        }
-        else if (parameters[i] == "value")
-        {
-            showValue = true;
-        }
-        else if (parameters[i] == "hell")
-        {
-            showHidden = showTube = true;
-        }
-        else
-            return CR_WRONG_USAGE;
-    }
+struct ProspectResult
+{
+    bool hasAquifer;
+    bool hasDemonTemple;
+    bool hasLair;
 
-    CoreSuspender suspend;
+    MatHistogram baseMats;
+    MatHistogram layerMats;
+    MatHistogram veinMats;
+    MatHistogram plantMats;
+    MatHistogram treeMats;
 
-    // Embark screen active: estimate using world geology data
-    auto screen = Gui::getViewscreenByType<df::viewscreen_choose_start_sitest>(0);
-    if (screen)
-        return embark_prospector(con, screen, showHidden, showValue);
+    matdata liquidWater;
+    matdata liquidMagma;
+    matdata aquiferTiles;
+    matdata tubeTiles;
 
-    if (!Maps::IsValid())
+    ProspectResult()
+        : hasAquifer(false), hasDemonTemple(false), hasLair(false),
+          baseMats(ENUM_LAST_ITEM(tiletype_material)+1),
+          layerMats(world->raws.inorganics.size()),
+          veinMats(world->raws.inorganics.size()),
+          plantMats(world->raws.plants.all.size()),
+          treeMats(world->raws.plants.all.size())
+    {}
+
+    void merge(const ProspectResult &other)
     {
-        con.printerr("Map is not available!\n");
-        return CR_FAILURE;
+        hasAquifer = hasAquifer || other.hasAquifer;
+        hasDemonTemple = hasDemonTemple || other.hasDemonTemple;
+        hasLair = hasLair || other.hasLair;
+
+        histogram_merge(baseMats, other.baseMats);
+        histogram_merge(layerMats, other.layerMats);
+        histogram_merge(veinMats, other.veinMats);
+        histogram_merge(plantMats, other.plantMats);
+        histogram_merge(treeMats, other.treeMats);
+
+        liquidWater.merge(other.liquidWater);
+        liquidMagma.merge(other.liquidMagma);
+        aquiferTiles.merge(other.aquiferTiles);
+        tubeTiles.merge(other.tubeTiles);
     }
+};
 
-    uint32_t x_max = 0, y_max = 0, z_max = 0;
-    Maps::getSize(x_max, y_max, z_max);
-    MapExtras::MapCache map;
-
-    DFHack::Materials *mats = Core::getInstance().getMaterials();
-
+static void scan_column(MapExtras::MapCache &map, const ProspectOptions &opts,
+                        ProspectResult &res, uint32_t b_x, uint32_t b_y, uint32_t z_max)
+{
     DFHack::t_feature blockFeatureGlobal;
     DFHack::t_feature blockFeatureLocal;
 
-    bool hasAquifer = false;
-    bool hasDemonTemple = false;
-    bool hasLair = false;
-    MatMap baseMats;
-    MatMap layerMats;
-    MatMap veinMats;
-    MatMap plantMats;
-    MatMap treeMats;
+    for (uint32_t z = 0; z < z_max; z++)
+    {
+        // Get the map block
+        MapExtras::Block *b = map.BlockAt(DFHack::DFCoord(b_x, b_y, z));
+        if (!b || !b->is_valid())
+        {
+            continue;
+        }
 
-    matdata liquidWater;
-    matdata liquidMagma;
-    matdata aquiferTiles;
-    matdata tubeTiles;
+        // Find features
+        b->GetGlobalFeature(&blockFeatureGlobal);
+        b->GetLocalFeature(&blockFeatureLocal);
 
-    uint32_t vegCount = 0;
+        int global_z = world->map.region_z + z;
 
-    for(uint32_t z = 0; z < z_max; z++)
-    {
-        for(uint32_t b_y = 0; b_y < y_max; b_y++)
+        // Iterate over all the tiles in the block
+        for(uint32_t y = 0; y < 16; y++)
         {
-            for(uint32_t b_x = 0; b_x < x_max; b_x++)
+            for(uint32_t x = 0; x < 16; x++)
             {
-                // Get the map block
-                df::coord2d blockCoord(b_x, b_y);
-                MapExtras::Block *b = map.BlockAt(DFHack::DFCoord(b_x, b_y, z));
-                if (!b || !b->is_valid())
+                df::coord2d coord(x, y);
+                df::tile_designation des = b->DesignationAt(coord);
+                df::tile_occupancy occ = b->OccupancyAt(coord);
+
+                // Skip hidden tiles
+                if (!opts.showHidden && des.bits.hidden)
                 {
                     continue;
                 }
 
-                // Find features
-                b->GetGlobalFeature(&blockFeatureGlobal);
-                b->GetLocalFeature(&blockFeatureLocal);
-
-                int global_z = world->map.region_z + z;
-
-                // Iterate over all the tiles in the block
-                for(uint32_t y = 0; y < 16; y++)
+                // Check for aquifer
+                if (des.bits.water_table)
                 {
-                    for(uint32_t x = 0; x < 16; x++)
-                    {
-                        df::coord2d coord(x, y);
-                        df::tile_designation des = b->DesignationAt(coord);
-                        df::tile_occupancy occ = b->OccupancyAt(coord);
+                    res.hasAquifer = true;
+                    res.aquiferTiles.add(global_z);
+                }
 
-                        // Skip hidden tiles
-                        if (!showHidden && des.bits.hidden)
-                        {
-                            continue;
-                        }
+                // Check for lairs
+                if (occ.bits.monster_lair)
+                {
+                    res.hasLair = true;
+                }
 
-                        // Check for aquifer
-                        if (des.bits.water_table)
-                        {
-                            hasAquifer = true;
-                            aquiferTiles.add(global_z);
-                        }
+                // Check for liquid
+                if (des.bits.flow_size)
+                {
+                    if (des.bits.liquid_type == tile_liquid::Magma)
+                        res.liquidMagma.add(global_z);
+                    else
+                        res.liquidWater.add(global_z);
+                }
 
-                        // Check for lairs
-                        if (occ.bits.monster_lair)
-                        {
-                            hasLair = true;
-                        }
+                df::tiletype type = b->tiletypeAt(coord);
+                df::tiletype_shape tileshape = tileShape(type);
+                df::tiletype_material tilemat = tileMaterial(type);
 
-                        // Check for liquid
-                        if (des.bits.flow_size)
-                        {
-                            if (des.bits.liquid_type == tile_liquid::Magma)
-                                liquidMagma.add(global_z);
-                            else
-                                liquidWater.add(global_z);
-                        }
+                // We only care about these types
+                switch (tileshape)
+                {
+                case tiletype_shape::WALL:
+                case tiletype_shape::FORTIFICATION:
+                    break;
+                case tiletype_shape::EMPTY:
+                    /* A heuristic: tubes inside adamantine have EMPTY:AIR tiles which
+                       still have feature_local set. Also check the unrevealed status,
+                       so as to exclude any holes mined by the player. */
+                    if (tilemat == tiletype_material::AIR &&
+                        des.bits.feature_local && des.bits.hidden &&
+                        blockFeatureLocal.type == feature_type::deep_special_tube)
+                    {
+                        res.tubeTiles.add(global_z);
+                    }
+                default:
+                    continue;
+                }
 
-                        df::tiletype type = b->tiletypeAt(coord);
-                        df::tiletype_shape tileshape = tileShape(type);
-                        df::tiletype_material tilemat = tileMaterial(type);
+                // Count the material type
+                histogram_add(res.baseMats, tilemat, global_z);
 
-                        // We only care about these types
-                        switch (tileshape)
+                // Find the type of the tile
+                switch (tilemat)
+                {
+                case tiletype_material::SOIL:
+                case tiletype_material::STONE:
+                    histogram_add(res.layerMats, b->layerMaterialAt(coord), global_z);
+                    break;
+                case tiletype_material::MINERAL:
+                    histogram_add(res.veinMats, b->veinMaterialAt(coord), global_z);
+                    break;
+                case tiletype_material::FEATURE:
+                    if (blockFeatureLocal.type != -1 && des.bits.feature_local)
+                    {
+                        if (blockFeatureLocal.type == feature_type::deep_special_tube
+                                && blockFeatureLocal.main_material == 0) // stone
                         {
-                        case tiletype_shape::WALL:
-                        case tiletype_shape::FORTIFICATION:
-                            break;
-                        case tiletype_shape::EMPTY:
-                            /* A heuristic: tubes inside adamantine have EMPTY:AIR tiles which
-                               still have feature_local set. Also check the unrevealed status,
-                               so as to exclude any holes mined by the player. */
-                            if (tilemat == tiletype_material::AIR &&
-                                des.bits.feature_local && des.bits.hidden &&
-                                blockFeatureLocal.type == feature_type::deep_special_tube)
-                            {
-                                tubeTiles.add(global_z);
-                            }
-                        default:
-                            continue;
+                            histogram_add(res.veinMats, blockFeatureLocal.sub_material, global_z);
                         }
-
-                        // Count the material type
-                        baseMats[tilemat].add(global_z);
-
-                        // Find the type of the tile
-                        switch (tilemat)
+                        else if (opts.showTemple
+                                 && blockFeatureLocal.type == feature_type::deep_surface_portal)
                         {
-                        case tiletype_material::SOIL:
-                        case tiletype_material::STONE:
-                            layerMats[b->layerMaterialAt(coord)].add(global_z);
-                            break;
-                        case tiletype_material::MINERAL:
-                            veinMats[b->veinMaterialAt(coord)].add(global_z);
-                            break;
-                        case tiletype_material::FEATURE:
-                            if (blockFeatureLocal.type != -1 && des.bits.feature_local)
-                            {
-                                if (blockFeatureLocal.type == feature_type::deep_special_tube
-                                        && blockFeatureLocal.main_material == 0) // stone
-                                {
-                                    veinMats[blockFeatureLocal.sub_material].add(global_z);
-                                }
-                                else if (showTemple
-                                         && blockFeatureLocal.type == feature_type::deep_surface_portal)
-                                {
-                                    hasDemonTemple = true;
-                                }
-                            }
-
-                            if (showSlade && blockFeatureGlobal.type != -1 && des.bits.feature_global
-                                    && blockFeatureGlobal.type == feature_type::underworld_from_layer
-                                    && blockFeatureGlobal.main_material == 0) // stone
-                            {
-                                layerMats[blockFeatureGlobal.sub_material].add(global_z);
-                            }
-                            break;
-                        case tiletype_material::LAVA_STONE:
-                            // TODO ?
-                            break;
-                        default:
-                            break;
+                            res.hasDemonTemple = true;
                         }
                     }
-                }
 
-                // Check plants this way, as the other way wasn't getting them all
-                // and we can check visibility more easily here
-                if (showPlants)
-                {
-                    auto block = Maps::getBlockColumn(b_x,b_y);
-                    vector<df::plant *> *plants = block ? &block->plants : NULL;
-                    if(plants)
+                    if (opts.showSlade && blockFeatureGlobal.type != -1 && des.bits.feature_global
+                            && blockFeatureGlobal.type == feature_type::underworld_from_layer
+                            && blockFeatureGlobal.main_material == 0) // stone
                     {
-                        for (PlantList::const_iterator it = plants->begin(); it != plants->end(); it++)
-                        {
-                            const df::plant & plant = *(*it);
-                            if (uint32_t(plant.pos.z) != z)
-                                continue;
-                            df::coord2d loc(plant.pos.x, plant.pos.y);
-                            loc = loc % 16;
-                            if (showHidden || !b->DesignationAt(loc).bits.hidden)
-                            {
-                                if(plant.flags.bits.is_shrub)
-                                    plantMats[plant.material].add(global_z);
-                                else
-                                    treeMats[plant.material].add(global_z);
-                            }
-                        }
+                        histogram_add(res.layerMats, blockFeatureGlobal.sub_material, global_z);
                     }
+                    break;
+                case tiletype_material::LAVA_STONE:
+                    // TODO ?
+                    break;
+                default:
+                    break;
                 }
-                // Block end
-            } // block x
+            }
+        }
+        // Block end
+    }
+
+    // Check plants this way, as the other way wasn't getting them all
+    // and we can check visibility more easily here
+    if (opts.showPlants)
+    {
+        auto column = Maps::getBlockColumn(b_x,b_y);
+        if (!column)
+            return;
+
+        for (PlantList::const_iterator it = column->plants.begin(); it != column->plants.end(); it++)
+        {
+            const df::plant & plant = *(*it);
+            if (plant.pos.z < 0 || uint32_t(plant.pos.z) >= z_max)
+                continue;
+
+            MapExtras::Block *b = map.BlockAt(DFHack::DFCoord(b_x, b_y, plant.pos.z));
+            if (!b || !b->is_valid())
+                continue;
+
+            df::coord2d loc(plant.pos.x, plant.pos.y);
+            loc = loc % 16;
+            if (opts.showHidden || !b->DesignationAt(loc).bits.hidden)
+            {
+                int global_z = world->map.region_z + plant.pos.z;
+                if(plant.flags.bits.is_shrub)
+                    histogram_add(res.plantMats, plant.material, global_z);
+                else
+                    histogram_add(res.treeMats, plant.material, global_z);
+            }
+        }
+    }
+}
+
+static void scan_worker(const ProspectOptions *opts, ProspectResult *res,
+                        std::atomic<size_t> *next_column,
+                        uint32_t x_max, uint32_t y_max, uint32_t z_max)
+{
+    MapExtras::MapCache map;
+    size_t num_columns = size_t(x_max) * y_max;
+
+    for (size_t i = (*next_column)++; i < num_columns; i = (*next_column)++)
+    {
+        scan_column(map, *opts, *res, i % x_max, i / x_max, z_max);
+
+        // Clean uneeded memory
+        map.trash();
+    }
+}
+
+static unsigned scan_thread_count(size_t num_columns)
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+    threads = std::min(threads, MAX_SCAN_THREADS);
+    return unsigned(std::min<size_t>(threads, std::max<size_t>(num_columns, 1)));
+}
+
+/* Scans the whole map. Must be called with the core suspended. */
+static void scan_map(const ProspectOptions &opts, ProspectResult &result)
+{
+    uint32_t x_max = 0, y_max = 0, z_max = 0;
+    Maps::getSize(x_max, y_max, z_max);
+
+    size_t num_columns = size_t(x_max) * y_max;
+    unsigned num_threads = scan_thread_count(num_columns);
+    std::atomic<size_t> next_column(0);
+
+    if (num_threads <= 1)
+    {
+        scan_worker(&opts, &result, &next_column, x_max, y_max, z_max);
+        return;
+    }
+
+    // The calling thread acts as the first worker
+    std::vector<ProspectResult> partial(num_threads - 1);
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+
+    for (unsigned i = 0; i < num_threads - 1; i++)
+        threads.emplace_back(scan_worker, &opts, &partial[i], &next_column, x_max, y_max, z_max);
+
+    scan_worker(&opts, &result, &next_column, x_max, y_max, z_max);
+
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+        result.merge(partial[i]);
+    }
+}
+
+command_result prospector (color_ostream &con, vector <string> & parameters)
+{
+    ProspectOptions opts;
+    bool showValue = false;
+    bool showTube = false;
+
+    for(size_t i = 0; i < parameters.size();i++)
+    {
+        if (parameters[i] == "all")
+        {
+            opts.showHidden = true;
+        }
+        else if (parameters[i] == "value")
+        {
+            showValue = true;
+        }
+        else if (parameters[i] == "hell")
+        {
+            opts.showHidden = showTube = true;
+        }
+        else
+            return CR_WRONG_USAGE;
+    }
+
+    CoreSuspender suspend;
 
-            // Clean uneeded memory
-            map.trash();
-        } // block y
-    } // z
+    // Embark screen active: estimate using world geology data
+    auto screen = Gui::getViewscreenByType<df::viewscreen_choose_start_sitest>(0);
+    if (screen)
+        return embark_prospector(con, screen, opts.showHidden, showValue);
+
+    if (!Maps::IsValid())
+    {
+        con.printerr("Map is not available!\n");
+        return CR_FAILURE;
+    }
+
+    DFHack::Materials *mats = Core::getInstance().getMaterials();
+
+    ProspectResult res;
+    scan_map(opts, res);
+
+    MatMap baseMats, layerMats, veinMats, plantMats, treeMats;
+    histogram_to_map(res.baseMats, baseMats);
+    histogram_to_map(res.layerMats, layerMats);
+    histogram_to_map(res.veinMats, veinMats);
+    histogram_to_map(res.plantMats, plantMats);
+    histogram_to_map(res.treeMats, treeMats);
 
     MatMap::const_iterator it;
 
@@ -786,18 +947,18 @@ command_result prospector (color_ostream &con, vector <string> & parameters)
         con << std::setw(25) << ENUM_KEY_STR(tiletype_material,(df::tiletype_material)it->first) << " : " << it->second.count << std::endl;
     }
 
-    if (liquidWater.count || liquidMagma.count)
+    if (res.liquidWater.count || res.liquidMagma.count)
     {
         con << std::endl << "Liquids:" << std::endl;
-        if (liquidWater.count)
+        if (res.liquidWater.count)
         {
             con << std::setw(25) << "WATER" << " : ";
-            printMatdata(con, liquidWater);
+            printMatdata(con, res.liquidWater);
         }
-        if (liquidWater.count)
+        if (res.liquidMagma.count)
         {
             con << std::setw(25) << "MAGMA" << " : ";
-            printMatdata(con, liquidMagma);
+            printMatdata(con, res.liquidMagma);
         }
     }
 
@@ -806,7 +967,7 @@ command_result prospector (color_ostream &con, vector <string> & parameters)
 
     printVeins(con, veinMats, mats, showValue);
 
-    if (showPlants)
+    if (opts.showPlants)
     {
         con << "Shrubs:" << std::endl;
         printMats<df::plant_raw, std::greater>(con, plantMats, world->raws.plants.all, showValue);
@@ -814,30 +975,30 @@ command_result prospector (color_ostream &con, vector <string> & parameters)
         printMats<df::plant_raw, std::greater>(con, treeMats, world->raws.plants.all, showValue);
     }
 
-    if (hasAquifer)
+    if (res.hasAquifer)
     {
         con << "Has aquifer";
-        if (aquiferTiles.count)
+        if (res.aquiferTiles.count)
         {
             con << "               : ";
-            printMatdata(con, aquiferTiles);
+            printMatdata(con, res.aquiferTiles);
         }
         else
             con << std::endl;
     }
 
-    if (showTube && tubeTiles.count)
+    if (showTube && res.tubeTiles.count)
     {
         con << "Has HFS tubes             : ";
-        printMatdata(con, tubeTiles);
+        printMatdata(con, res.tubeTiles);
     }
 
-    if (hasDemonTemple)
+    if (res.hasDemonTemple)
     {
         con << "Has demon temple" << std::endl;
     }
 
-    if (hasLair)
+    if (res.hasLair)
     {
         con << "Has lair" << std::endl;
     }
@@ -847,3 +1008,190 @@ command_result prospector (color_ostream &con, vector <string> & parameters)
     con << std::endl;
     return CR_OK;
 }
+
+/*
+ * Structured histograms for Lua and remote clients
+ */
+
+template<typename T>
+static std::string raw_token(std::vector<T*> &raws, size_t index)
+{
+    // Works for both df::inorganic_raw and df::plant_raw, see printMats
+    return index < raws.size() ? raws[index]->id : std::string();
+}
+
+static std::string tilemat_token(size_t index)
+{
+    return ENUM_KEY_STR(tiletype_material, (df::tiletype_material)index);
+}
+
+static void push_matdata(lua_State *L, const matdata &data)
+{
+    lua_newtable(L);
+    Lua::TableInsert(L, "count", data.count);
+    if (data.lower_z != matdata::invalid_z)
+    {
+        Lua::TableInsert(L, "min_z", data.lower_z);
+        Lua::TableInsert(L, "max_z", data.upper_z);
+    }
+}
+
+template<typename T>
+static void push_histogram(lua_State *L, const MatHistogram &hist, T token_fn)
+{
+    lua_newtable(L);
+    int n = 0;
+    for (size_t i = 0; i < hist.size(); i++)
+    {
+        if (!hist[i].count)
+            continue;
+        push_matdata(L, hist[i]);
+        Lua::TableInsert(L, "index", int(i));
+        Lua::TableInsert(L, "token", token_fn(i));
+        lua_rawseti(L, -2, ++n);
+    }
+}
+
+static bool get_bool_field(lua_State *L, int idx, const char *name, bool dflt)
+{
+    if (!lua_istable(L, idx))
+        return dflt;
+    lua_getfield(L, idx, name);
+    bool rv = lua_isnil(L, -1) ? dflt : lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    return rv;
+}
+
+static int getHistograms(lua_State *L)
+{
+    ProspectOptions opts;
+    opts.showHidden = get_bool_field(L, 1, "all", opts.showHidden);
+    opts.showPlants = get_bool_field(L, 1, "plants", opts.showPlants);
+    opts.showSlade = get_bool_field(L, 1, "slade", opts.showSlade);
+    opts.showTemple = get_bool_field(L, 1, "temple", opts.showTemple);
+
+    if (!Maps::IsValid())
+        luaL_error(L, "map is not available");
+
+    ProspectResult res;
+    scan_map(opts, res);
+
+    auto &inorganics = world->raws.inorganics;
+    auto &plants = world->raws.plants.all;
+
+    lua_newtable(L);
+
+    push_histogram(L, res.baseMats, tilemat_token);
+    lua_setfield(L, -2, "base");
+    push_histogram(L, res.layerMats, [&](size_t i) { return raw_token(inorganics, i); });
+    lua_setfield(L, -2, "layer");
+    push_histogram(L, res.veinMats, [&](size_t i) { return raw_token(inorganics, i); });
+    lua_setfield(L, -2, "vein");
+    if (opts.showPlants)
+    {
+        push_histogram(L, res.plantMats, [&](size_t i) { return raw_token(plants, i); });
+        lua_setfield(L, -2, "shrub");
+        push_histogram(L, res.treeMats, [&](size_t i) { return raw_token(plants, i); });
+        lua_setfield(L, -2, "tree");
+    }
+
+    push_matdata(L, res.liquidWater);
+    lua_setfield(L, -2, "water");
+    push_matdata(L, res.liquidMagma);
+    lua_setfield(L, -2, "magma");
+    push_matdata(L, res.aquiferTiles);
+    lua_setfield(L, -2, "aquifer");
+    push_matdata(L, res.tubeTiles);
+    lua_setfield(L, -2, "tube");
+
+    Lua::TableInsert(L, "has_aquifer", res.hasAquifer);
+    Lua::TableInsert(L, "has_demon_temple", res.hasDemonTemple);
+    Lua::TableInsert(L, "has_lair", res.hasLair);
+    return 1;
+}
+
+DFHACK_PLUGIN_LUA_COMMANDS {
+    DFHACK_LUA_COMMAND(getHistograms),
+    DFHACK_LUA_END
+};
+
+static void fill_matdata(MatHistogramEntry *out, const matdata &data)
+{
+    out->set_count(data.count);
+    if (data.lower_z != matdata::invalid_z)
+    {
+        out->set_min_z(data.lower_z);
+        out->set_max_z(data.upper_z);
+    }
+}
+
+template<typename T>
+static void fill_histogram(google::protobuf::RepeatedPtrField<MatHistogramEntry> *out,
+                           const MatHistogram &hist, T token_fn)
+{
+    for (size_t i = 0; i < hist.size(); i++)
+    {
+        if (!hist[i].count)
+            continue;
+        auto entry = out->Add();
+        entry->set_index(i);
+        entry->set_token(token_fn(i));
+        fill_matdata(entry, hist[i]);
+    }
+}
+
+static command_result GetHistograms(color_ostream &stream, const ProspectRequest *in, ProspectReply *out)
+{
+    if (!Maps::IsValid())
+    {
+        out->set_available(false);
+        return CR_OK;
+    }
+
+    ProspectOptions opts;
+    if (in->has_all())
+        opts.showHidden = in->all();
+    if (in->has_plants())
+        opts.showPlants = in->plants();
+    if (in->has_slade())
+        opts.showSlade = in->slade();
+    if (in->has_temple())
+        opts.showTemple = in->temple();
+
+    ProspectResult res;
+    scan_map(opts, res);
+
+    auto &inorganics = world->raws.inorganics;
+    auto &plants = world->raws.plants.all;
+
+    out->set_available(true);
+    fill_histogram(out->mutable_base(), res.baseMats, tilemat_token);
+    fill_histogram(out->mutable_layer(), res.layerMats,
+                   [&](size_t i) { return raw_token(inorganics, i); });
+    fill_histogram(out->mutable_vein(), res.veinMats,
+                   [&](size_t i) { return raw_token(inorganics, i); });
+    if (opts.showPlants)
+    {
+        fill_histogram(out->mutable_shrub(), res.plantMats,
+                       [&](size_t i) { return raw_token(plants, i); });
+        fill_histogram(out->mutable_tree(), res.treeMats,
+                       [&](size_t i) { return raw_token(plants, i); });
+    }
+
+    fill_matdata(out->mutable_water(), res.liquidWater);
+    fill_matdata(out->mutable_magma(), res.liquidMagma);
+    fill_matdata(out->mutable_aquifer(), res.aquiferTiles);
+    fill_matdata(out->mutable_tube(), res.tubeTiles);
+
+    out->set_has_aquifer(res.hasAquifer);
+    out->set_has_demon_temple(res.hasDemonTemple);
+    out->set_has_lair(res.hasLair);
+    return CR_OK;
+}
+
+DFhackCExport RPCService *plugin_rpcconnect(color_ostream &)
+{
+    RPCService *svc = new RPCService();
+    svc->addFunction("GetHistograms", GetHistograms);
+    return svc;
+}
@@ -294,11 +294,11 @@ DFhackCExport command_result plugin_init(color_ostream &out, std::vector <Plugin
 DFhackCExport RPCService *plugin_rpcconnect(color_ostream &)
 {
     RPCService *svc = new RPCService();
-    svc->addFunction("GetMaterialList", GetMaterialList, SF_ALLOW_REMOTE);
-    svc->addFunction("GetGrowthList", GetGrowthList, SF_ALLOW_REMOTE);
+    svc->addFunction("GetMaterialList", GetMaterialList, SF_ALLOW_REMOTE | SF_SNAPSHOT);
+    svc->addFunction("GetGrowthList", GetGrowthList, SF_ALLOW_REMOTE | SF_SNAPSHOT);
     svc->addFunction("GetBlockList", GetBlockList, SF_ALLOW_REMOTE);
     svc->addFunction("CheckHashes", CheckHashes, SF_ALLOW_REMOTE);
-    svc->addFunction("GetTiletypeList", GetTiletypeList, SF_ALLOW_REMOTE);
+    svc->addFunction("GetTiletypeList", GetTiletypeList, SF_ALLOW_REMOTE | SF_SNAPSHOT);
     svc->addFunction("GetPlantList", GetPlantList, SF_ALLOW_REMOTE);
     svc->addFunction("GetUnitList", GetUnitList, SF_ALLOW_REMOTE);
     svc->addFunction("GetUnitListInside", GetUnitListInside, SF_ALLOW_REMOTE);
@@ -306,29 +306,29 @@ DFhackCExport RPCService *plugin_rpcconnect(color_ostream &)
     svc->addFunction("GetMapInfo", GetMapInfo, SF_ALLOW_REMOTE);
     svc->addFunction("ResetMapHashes", ResetMapHashes, SF_ALLOW_REMOTE);
     svc->addFunction("GetItemList", GetItemList, SF_ALLOW_REMOTE);
-    svc->addFunction("GetBuildingDefList", GetBuildingDefList, SF_ALLOW_REMOTE);
+    svc->addFunction("GetBuildingDefList", GetBuildingDefList, SF_ALLOW_REMOTE | SF_SNAPSHOT);
     svc->addFunction("GetWorldMap", GetWorldMap, SF_ALLOW_REMOTE);
     svc->addFunction("GetWorldMapNew", GetWorldMapNew, SF_ALLOW_REMOTE);
     svc->addFunction("GetRegionMaps", GetRegionMaps, SF_ALLOW_REMOTE);
     svc->addFunction("GetRegionMapsNew", GetRegionMapsNew, SF_ALLOW_REMOTE);
-    svc->addFunction("GetCreatureRaws", GetCreatureRaws, SF_ALLOW_REMOTE);
-    svc->addFunction("GetPartialCreatureRaws", GetPartialCreatureRaws, SF_ALLOW_REMOTE);
+    svc->addFunction("GetCreatureRaws", GetCreatureRaws, SF_ALLOW_REMOTE | SF_SNAPSHOT);
+    svc->addFunction("GetPartialCreatureRaws", GetPartialCreatureRaws, SF_ALLOW_REMOTE | SF_SNAPSHOT);
     svc->addFunction("GetWorldMapCenter", GetWorldMapCenter, SF_ALLOW_REMOTE);
-    svc->addFunction("GetPlantRaws", GetPlantRaws, SF_ALLOW_REMOTE);
-    svc->addFunction("GetPartialPlantRaws", GetPartialPlantRaws, SF_ALLOW_REMOTE);
+    svc->addFunction("GetPlantRaws", GetPlantRaws, SF_ALLOW_REMOTE | SF_SNAPSHOT);
+    svc->addFunction("GetPartialPlantRaws", GetPartialPlantRaws, SF_ALLOW_REMOTE | SF_SNAPSHOT);
     svc->addFunction("CopyScreen", CopyScreen, SF_ALLOW_REMOTE);
     svc->addFunction("PassKeyboardEvent", PassKeyboardEvent, SF_ALLOW_REMOTE);
     svc->addFunction("SendDigCommand", SendDigCommand, SF_ALLOW_REMOTE);
     svc->addFunction("SetPauseState", SetPauseState, SF_ALLOW_REMOTE);
     svc->addFunction("GetPauseState", GetPauseState, SF_ALLOW_REMOTE);
-    svc->addFunction("GetVersionInfo", GetVersionInfo, SF_ALLOW_REMOTE);
+    svc->addFunction("GetVersionInfo", GetVersionInfo, SF_ALLOW_REMOTE | SF_SNAPSHOT);
     svc->addFunction("GetReports", GetReports, SF_ALLOW_REMOTE);
     svc->addFunction("MoveCommand", MoveCommand, SF_ALLOW_REMOTE);
     svc->addFunction("JumpCommand", JumpCommand, SF_ALLOW_REMOTE);
     svc->addFunction("MenuQuery", MenuQuery, SF_ALLOW_REMOTE);
     svc->addFunction("MovementSelectCommand", MovementSelectCommand, SF_ALLOW_REMOTE);
     svc->addFunction("MiscMoveCommand", MiscMoveCommand, SF_ALLOW_REMOTE);
-    svc->addFunction("GetLanguage", GetLanguage, SF_ALLOW_REMOTE);
+    svc->addFunction("GetLanguage", GetLanguage, SF_ALLOW_REMOTE | SF_SNAPSHOT);
     return svc;
 }
 
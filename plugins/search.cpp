@@ -1,3 +1,5 @@
+#include <unordered_map>
+
 #include "MiscUtils.h"
 #include "VTableInterpose.h"
 #include "uicommon.h"
@@ -145,6 +147,116 @@ static bool cursor_key_pressed (std::set<df::interface_key> *input)
     input->count(df::interface_key::CURSOR_DOWN_Z_AUX);
 }
 
+/*
+ * Lowercased descriptions of a saved list, plus a trigram index over them.
+ * Built once when a search starts on a list, so that later keystrokes only
+ * look at entries that can still match instead of re-describing the whole
+ * list. A query that extends the previous one is filtered from the previous
+ * result set.
+ */
+class search_index
+{
+public:
+    search_index()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        descs.clear();
+        trigrams.clear();
+        last_query.clear();
+        last_matches.clear();
+        has_last = false;
+    }
+
+    void reserve(size_t count)
+    {
+        descs.reserve(count);
+    }
+
+    // Appends the (already lowercased) description of the next list entry
+    void add(const string &desc)
+    {
+        uint32_t index = uint32_t(descs.size());
+        descs.push_back(desc);
+
+        for (size_t i = 0; i + 3 <= desc.size(); i++)
+        {
+            auto &postings = trigrams[trigram_key(&desc[i])];
+            if (postings.empty() || postings.back() != index)
+                postings.push_back(index);
+        }
+    }
+
+    // Returns the ascending indices of entries whose description contains query
+    const vector<uint32_t> &find(const string &query)
+    {
+        vector<uint32_t> matches;
+
+        if (has_last && query.compare(0, last_query.size(), last_query) == 0)
+        {
+            filter(matches, last_matches, query);
+        }
+        else if (query.size() >= 3)
+        {
+            // Every match contains all trigrams of the query, so the
+            // shortest posting list is a complete candidate set.
+            const vector<uint32_t> *best = NULL;
+            for (size_t i = 0; i + 3 <= query.size(); i++)
+            {
+                auto it = trigrams.find(trigram_key(&query[i]));
+                if (it == trigrams.end())
+                {
+                    best = NULL;
+                    break;
+                }
+                if (!best || it->second.size() < best->size())
+                    best = &it->second;
+            }
+
+            if (best)
+                filter(matches, *best, query);
+        }
+        else
+        {
+            for (size_t i = 0; i < descs.size(); i++)
+            {
+                if (descs[i].find(query) != string::npos)
+                    matches.push_back(uint32_t(i));
+            }
+        }
+
+        last_query = query;
+        last_matches.swap(matches);
+        has_last = true;
+        return last_matches;
+    }
+
+private:
+    static uint32_t trigram_key(const char *p)
+    {
+        return uint32_t(uint8_t(p[0])) | (uint32_t(uint8_t(p[1])) << 8) | (uint32_t(uint8_t(p[2])) << 16);
+    }
+
+    void filter(vector<uint32_t> &out, const vector<uint32_t> &candidates, const string &query) const
+    {
+        out.reserve(candidates.size());
+        for (auto index : candidates)
+        {
+            if (descs[index].find(query) != string::npos)
+                out.push_back(index);
+        }
+    }
+
+    vector<string> descs;
+    std::unordered_map<uint32_t, vector<uint32_t>> trigrams;
+    string last_query;
+    vector<uint32_t> last_matches;
+    bool has_last;
+};
+
 //
 // START: Generic Search functionality
 //
@@ -330,6 +442,7 @@ protected:
         end_entry_mode();
         search_string = "";
         saved_list1.clear();
+        desc_index.clear();
     }
 
     // Shortcut to clear the search immediately
@@ -340,6 +453,7 @@ protected:
             *primary_list = saved_list1;
             saved_list1.clear();
         }
+        desc_index.clear();
         search_string = "";
     }
 
@@ -388,31 +502,26 @@ protected:
         }
 
         if (saved_list1.size() == 0)
-            // On first run, save the original list
+        {
+            // On first run, save the original list and index it
             save_original_values();
+            build_index();
+        }
         else
             do_pre_incremental_search();
 
         clear_viewscreen_vectors();
 
-        string search_string_l = toLower(search_string);
+        auto &matches = desc_index.find(toLower(search_string));
+        auto match = matches.begin();
         for (size_t i = 0; i < saved_list1.size(); i++ )
         {
-            if (force_in_search(i))
-            {
-                add_to_filtered_list(i);
-                continue;
-            }
-
-            if (!is_valid_for_search(i))
-                continue;
+            bool is_match = (match != matches.end() && *match == i);
+            if (is_match)
+                ++match;
 
-            T element = saved_list1[i];
-            string desc = toLower(get_element_description(element));
-            if (desc.find(search_string_l) != string::npos)
-            {
+            if (force_in_search(i) || is_match)
                 add_to_filtered_list(i);
-            }
         }
 
         do_post_search();
@@ -426,6 +535,21 @@ protected:
         return true;
     }
 
+    void build_index()
+    {
+        desc_index.clear();
+        desc_index.reserve(saved_list1.size());
+        for (size_t i = 0; i < saved_list1.size(); i++)
+        {
+            // Forced and invalid entries are never matched, and may not
+            // even have a description (e.g. vermin on the pets screen)
+            if (force_in_search(i) || !is_valid_for_search(i))
+                desc_index.add("");
+            else
+                desc_index.add(toLower(get_element_description(saved_list1[i])));
+        }
+    }
+
     // Display hotkey message
     void print_search_option(int x, int y = -1) const
     {
@@ -446,6 +570,7 @@ protected:
 
     //bool redo_search;
     string search_string;
+    search_index desc_index;
 
 protected:
     int *cursor_pos;
@@ -1,5 +1,6 @@
 #include "Core.h"
 #include <Console.h>
+#include <MemAccess.h>
 #include <Export.h>
 #include <Error.h>
 #include <PluginManager.h>
@@ -15,6 +16,8 @@
 #include <LuaTools.h>
 #include <TileTypes.h>
 #include <vector>
+#include <unordered_map>
+#include <algorithm>
 #include <cstdio>
 #include <stack>
 #include <string>
@@ -352,6 +355,13 @@ struct EngineInfo {
     df::stockpile_links links;
     df::workshop_profile profile;
 
+    // Aim overlay results by target tile. They are dropped on the next
+    // tick, and after a short while in case tools edit the map while the
+    // game is paused.
+    std::unordered_map<uint64_t, int8_t> tile_status;
+    int32_t tile_status_frame;
+    uint32_t tile_status_time;
+
     bool hasTarget() { return is_range_valid(target); }
     bool onTarget(df::coord pos) { return is_in_range(target, pos); }
     df::coord getTargetSize() { return target.second - target.first; }
@@ -403,6 +413,8 @@ static EngineInfo *find_engine(df::building *bld, bool create = false)
     obj->ammo_item_type = item_type::BOULDER;
 
     obj->operator_id = obj->operator_frame = -1;
+    obj->tile_status_frame = -1;
+    obj->tile_status_time = 0;
 
     coord_engines[obj->center] = bld;
     return obj;
@@ -1099,13 +1111,42 @@ static TargetTileStatus calcTileStatus(EngineInfo *engine, df::coord target)
     return status;
 }
 
+static const size_t MAX_CACHED_TILES = 65536;
+static const uint32_t MAX_CACHED_TILE_AGE_MS = 250;
+
+static TargetTileStatus cachedTileStatus(EngineInfo *engine, df::coord target)
+{
+    auto &cache = engine->tile_status;
+    uint32_t now = Core::getInstance().p->getTickCount();
+
+    if (engine->tile_status_frame != world->frame_counter ||
+        now - engine->tile_status_time > MAX_CACHED_TILE_AGE_MS ||
+        cache.size() >= MAX_CACHED_TILES)
+    {
+        cache.clear();
+        engine->tile_status_frame = world->frame_counter;
+        engine->tile_status_time = now;
+    }
+
+    uint64_t key = (uint64_t(uint16_t(target.x)) << 32) |
+                   (uint64_t(uint16_t(target.y)) << 16) | uint16_t(target.z);
+
+    auto it = cache.find(key);
+    if (it != cache.end())
+        return TargetTileStatus(it->second);
+
+    auto status = calcTileStatus(engine, target);
+    cache[key] = int8_t(status);
+    return status;
+}
+
 static std::string getTileStatus(df::building_siegeenginest *bld, df::coord tile_pos)
 {
     auto engine = find_engine(bld, true);
     if (!engine)
         return "invalid";
 
-    return target_tile_type_names[calcTileStatus(engine, tile_pos)];
+    return target_tile_type_names[cachedTileStatus(engine, tile_pos)];
 }
 
 static void paintAimScreen(df::building_siegeenginest *bld, df::coord view, df::coord2d ltop, df::coord2d size)
@@ -1113,21 +1154,39 @@ static void paintAimScreen(df::building_siegeenginest *bld, df::coord view, df::
     auto engine = find_engine(bld, true);
     CHECK_NULL_POINTER(engine);
 
-    for (int x = 0; x < size.x; x++)
+    static Screen::TileSnapshot snap;
+    if (!Screen::readRect(&snap, ltop.x, ltop.y, ltop.x+size.x-1, ltop.y+size.y-1, true))
+        return;
+
+    std::vector<TargetTileStatus> row(size.x);
+
+    for (int y = 0; y < size.y; y++)
     {
-        for (int y = 0; y < size.y; y++)
+        // Trace the whole row first, then paint it
+        for (int x = 0; x < size.x; x++)
+        {
+            df::coord tile_pos = view + df::coord(x,y,0);
+            if (is_in_range(engine->building_rect, tile_pos) ||
+                !snap.inside(ltop.x+x, ltop.y+y))
+                continue;
+
+            row[x] = cachedTileStatus(engine, tile_pos);
+        }
+
+        for (int x = 0; x < size.x; x++)
         {
             df::coord tile_pos = view + df::coord(x,y,0);
-            if (is_in_range(engine->building_rect, tile_pos))
+            if (is_in_range(engine->building_rect, tile_pos) ||
+                !snap.inside(ltop.x+x, ltop.y+y))
                 continue;
 
-            Pen cur_tile = Screen::readTile(ltop.x+x, ltop.y+y, true);
+            Pen cur_tile = snap.get(snap.index(ltop.x+x, ltop.y+y));
             if (!cur_tile.valid())
                 continue;
 
             int color = COLOR_YELLOW;
 
-            switch (calcTileStatus(engine, tile_pos))
+            switch (row[x])
             {
                 case TARGET_OK:
                     color = COLOR_GREEN;
@@ -1172,7 +1231,11 @@ static const float MAX_TIME = 1000000.0f;
 
 struct UnitPath {
     df::unit *unit;
-    std::map<float, df::coord> path;
+
+    // Times at which the unit leaves each position, ascending; the last
+    // entry is MAX_TIME for where it ends up.
+    std::vector<float> times;
+    std::vector<df::coord> positions;
 
     struct Hit {
         UnitPath *path;
@@ -1181,24 +1244,72 @@ struct UnitPath {
         float time, lmargin, rmargin;
     };
 
-    static std::map<df::unit*, UnitPath*> cache;
+    static std::unordered_map<df::unit*, UnitPath*> cache;
+    static std::vector<UnitPath*> pool;
+
+    static const size_t MAX_POOLED = 512;
 
     static UnitPath *get(df::unit *unit)
     {
         auto &cv = cache[unit];
-        if (!cv) cv = new UnitPath(unit);
+        if (!cv)
+        {
+            if (pool.empty())
+                cv = new UnitPath();
+            else
+            {
+                cv = pool.back();
+                pool.pop_back();
+            }
+
+            cv->trace(unit);
+        }
         return cv;
     };
 
-    UnitPath(df::unit *unit) : unit(unit)
+    // Returns the cached paths to the pool, keeping their storage
+    static void clear()
+    {
+        for (auto it = cache.begin(); it != cache.end(); ++it)
+        {
+            if (pool.size() < MAX_POOLED)
+                pool.push_back(it->second);
+            else
+                delete it->second;
+        }
+
+        cache.clear();
+    }
+
+    size_t size() { return times.size(); }
+
+    void add(float time, df::coord pos)
     {
+        if (!times.empty() && times.back() >= time)
+        {
+            positions.back() = pos;
+            return;
+        }
+
+        times.push_back(time);
+        positions.push_back(pos);
+    }
+
+    void trace(df::unit *unit)
+    {
+        this->unit = unit;
+        times.clear();
+        positions.clear();
+
         if (unit->flags1.bits.rider)
         {
             auto mount = df::unit::find(unit->relationship_ids[df::unit_relationship_type::RiderMount]);
 
             if (mount)
             {
-                path = get(mount)->path;
+                auto mpath = get(mount);
+                times = mpath->times;
+                positions = mpath->positions;
                 return;
             }
         }
@@ -1231,30 +1342,29 @@ struct UnitPath {
                 // Meandering slowdown
                 delay += (slowdown - 1) * speed;
 
-                path[time] = pos;
+                add(time, pos);
                 pos = new_pos;
                 time += delay + 1;
             }
         }
 
-        path[MAX_TIME] = pos;
+        add(MAX_TIME, pos);
     }
 
-    void get_margin(std::map<float,df::coord>::iterator &it, float time, float *lmargin, float *rmargin)
+    void get_margin(size_t idx, float time, float *lmargin, float *rmargin)
     {
-        auto it2 = it;
-        *lmargin = (it == path.begin()) ? MAX_TIME : time - (--it2)->first;
-        *rmargin = (it->first == MAX_TIME) ? MAX_TIME : it->first - time;
+        *lmargin = (idx == 0) ? MAX_TIME : time - times[idx-1];
+        *rmargin = (times[idx] == MAX_TIME) ? MAX_TIME : times[idx] - time;
     }
 
     df::coord posAtTime(float time, float *lmargin = NULL, float *rmargin = NULL)
     {
         CHECK_INVALID_ARGUMENT(time < MAX_TIME);
 
-        auto it = path.upper_bound(time);
+        size_t idx = std::upper_bound(times.begin(), times.end(), time) - times.begin();
         if (lmargin)
-            get_margin(it, time, lmargin, rmargin);
-        return it->second;
+            get_margin(idx, time, lmargin, rmargin);
+        return positions[idx];
     }
 
     bool findHits(EngineInfo *engine, std::vector<Hit> *hit_points, float bias)
@@ -1264,12 +1374,12 @@ struct UnitPath {
         Hit info;
         info.path = this;
 
-        for (auto it = path.begin(); it != path.end(); ++it)
+        for (size_t i = 0; i < times.size(); i++)
         {
-            info.pos = it->second;
+            info.pos = positions[i];
             info.dist = point_distance(origin - info.pos);
             info.time = float(info.dist)*(engine->proj_speed+1) + engine->hit_delay + bias;
-            get_margin(it, info.time, &info.lmargin, &info.rmargin);
+            get_margin(i, info.time, &info.lmargin, &info.rmargin);
 
             if (info.lmargin > 0 && info.rmargin > 0)
             {
@@ -1282,7 +1392,8 @@ struct UnitPath {
     }
 };
 
-std::map<df::unit*, UnitPath*> UnitPath::cache;
+std::unordered_map<df::unit*, UnitPath*> UnitPath::cache;
+std::vector<UnitPath*> UnitPath::pool;
 
 static void push_margin(lua_State *L, float margin)
 {
@@ -1300,24 +1411,24 @@ static int traceUnitPath(lua_State *L)
 
     size_t idx = 1;
     auto info = UnitPath::get(unit);
-    lua_createtable(L, info->path.size(), 0);
+    lua_createtable(L, info->size(), 0);
 
     float last_time = 0.0f;
-    for (auto it = info->path.begin(); it != info->path.end(); ++it)
+    for (size_t i = 0; i < info->size(); i++)
     {
-        Lua::Push(L, it->second);
+        Lua::Push(L, info->positions[i]);
         if (idx > 1)
         {
             lua_pushnumber(L, last_time);
             lua_setfield(L, -2, "from");
         }
-        if (idx < info->path.size())
+        if (idx < info->size())
         {
-            lua_pushnumber(L, it->first);
+            lua_pushnumber(L, info->times[i]);
             lua_setfield(L, -2, "to");
         }
         lua_rawseti(L, -2, idx++);
-        last_time = it->first;
+        last_time = info->times[i];
     }
 
     return 1;
@@ -1983,13 +2094,7 @@ static bool enable_plugin()
 
 static void clear_caches(color_ostream &out)
 {
-    if (!UnitPath::cache.empty())
-    {
-        for (auto it = UnitPath::cache.begin(); it != UnitPath::cache.end(); ++it)
-            delete it->second;
-
-        UnitPath::cache.clear();
-    }
+    UnitPath::clear();
 }
 
 DFhackCExport command_result plugin_enable(color_ostream &out, bool enable)